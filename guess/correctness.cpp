@@ -8,6 +8,7 @@ using namespace chrono;
 
 // 编译指令如下：
 // g++ correctness.cpp train.cpp guessing.cpp md5.cpp -o test.exe
+// g++ correctness.cpp train.cpp guessing.cpp md5.cpp -o test.exe -fopenmp（测试多线程的md5_batch）
 
 
 // 通过这个函数，你可以验证你实现的SIMD哈希函数的正确性
@@ -77,6 +78,166 @@ int main()
     for (int i = 0; i < test_count; i++) {
         delete[] simd_states[i];
     }
+
+    // 测试多向量交错版本：输入数量故意不是4N的倍数，且长度各不相同
+    const int ways_count = 29;
+    string ways_inputs[ways_count];
+    bit32 ways_serial[ways_count][4];
+    for (int i = 0; i < ways_count; i++) {
+        ways_inputs[i] = testString.substr(0, i * 7 % 90) + to_string(i);
+        MD5Hash(ways_inputs[i], ways_serial[i]);
+    }
+    for (int ways = 1; ways <= 3; ways++) {
+        bit32* ways_states[ways_count];
+        for (int i = 0; i < ways_count; i++) {
+            ways_states[i] = new bit32[4];
+        }
+        MD5Hash_SIMD(ways_inputs, ways_count, ways_states, ways);
+        int mismatches = 0;
+        for (int i = 0; i < ways_count; i++) {
+            if (memcmp(ways_states[i], ways_serial[i], sizeof(ways_serial[i])) != 0) {
+                mismatches += 1;
+            }
+            delete[] ways_states[i];
+        }
+        cout << dec << ways << "路交错版本: " << (mismatches == 0 ? "全部匹配" : "存在不匹配!") << endl;
+    }
+
+    // 统一批量接口：长度0~130覆盖了每一种填充情况（包括长度模64为56~63的消息）
+    const int batch_count = 131;
+    string batch_inputs[batch_count];
+    bit32 batch_serial[batch_count][4];
+    for (int i = 0; i < batch_count; i++) {
+        batch_inputs[i] = string(i, 'a' + i % 26);
+        MD5Hash(batch_inputs[i], batch_serial[i]);
+    }
+    // 60个'a'的标准MD5，用于确认串行版本本身的填充是正确的
+    const bit32 expect60[4] = {0xcc7ed669, 0xcf88f201, 0xc3297c6a, 0x91e1d18d};
+    bit32 state60[4];
+    MD5Hash(string(60, 'a'), state60);
+    cout << "60字节消息: " << (memcmp(state60, expect60, sizeof(expect60)) == 0 ? "正确" : "错误!") << endl;
+    alignas(16) bit32 batch_digests[batch_count * 4];
+    MD5Impl impls[] = {MD5_IMPL_SCALAR, MD5_IMPL_NEON, MD5_IMPL_NEON_SCALAR1, MD5_IMPL_NEON_SCALAR2};
+    for (MD5Impl impl : impls) {
+        md5_batch(batch_inputs, batch_count, batch_digests, impl);
+        int mismatches = 0;
+        for (int i = 0; i < batch_count; i++) {
+            if (memcmp(batch_digests + 4 * i, batch_serial[i], sizeof(batch_serial[i])) != 0) {
+                mismatches += 1;
+            }
+        }
+        cout << "md5_batch(" << md5_impl_name(impl) << "): " << (mismatches == 0 ? "全部匹配" : "存在不匹配!") << endl;
+    }
+    cout << "当前CPU选择的实现: " << md5_impl_name(md5_select_impl()) << endl;
+
+    // 足够大的批次会被分给多个线程，检查各线程写入的摘要区间互不干扰
+    const int large_count = 50000;
+    vector<string> large_inputs(large_count);
+    for (int i = 0; i < large_count; i++) {
+        large_inputs[i] = testString.substr(0, i % 97) + to_string(i);
+    }
+    vector<bit32> large_digests(large_count * 4);
+    md5_batch(large_inputs.data(), large_count, large_digests.data());
+    int large_mismatches = 0;
+    for (int i = 0; i < large_count; i++) {
+        bit32 state[4];
+        MD5Hash(large_inputs[i], state);
+        if (memcmp(state, large_digests.data() + 4 * i, sizeof(state)) != 0) {
+            large_mismatches += 1;
+        }
+    }
+    cout << "多线程md5_batch(" << large_count << "条): " << (large_mismatches == 0 ? "全部匹配" : "存在不匹配!") << endl;
+
+    // 破解模式：少量目标（广播比较）和大量目标（逐通道查找）两种情况下，都只能报告真正命中的输入
+    const size_t hit_index[3] = {7, 12345, large_count - 1};
+    for (int target_count : {3, 200}) {
+        vector<bit32> target_digests;
+        for (int i = 0; i < target_count; i++) {
+            const bit32* d = large_digests.data() + 4 * (i < 3 ? hit_index[i] : (i * 131) % large_count);
+            bit32 digest[4] = {d[0], d[1], d[2], d[3] ^ (i < 3 ? 0u : 1u)}; // 其余目标与真实摘要只差最后一位
+            target_digests.insert(target_digests.end(), digest, digest + 4);
+        }
+        MD5TargetSet targets;
+        md5_build_targets(target_digests.data(), target_count, targets);
+        for (MD5Impl impl : impls) {
+            vector<MD5Hit> hits;
+            md5_crack_batch(large_inputs.data(), large_count, targets, hits, impl);
+            bool ok = hits.size() == 3;
+            for (size_t i = 0; ok && i < hits.size(); i++) {
+                ok = hits[i].index == hit_index[i] &&
+                     memcmp(hits[i].digest, large_digests.data() + 4 * hit_index[i], sizeof(hits[i].digest)) == 0;
+            }
+            cout << "md5_crack_batch(" << md5_impl_name(impl) << ", " << target_count << "个目标): " << (ok ? "正确" : "错误!") << endl;
+        }
+    }
+
+    // 从十六进制文件载入目标：大小写混合、夹杂无法解析的行，大量非命中目标走过滤器
+    {
+        const char* path = "correctness_targets.txt";
+        ofstream out(path);
+        out << "not a hash" << endl;
+        for (int i = 0; i < 5000; i++) {
+            const bit32* d = large_digests.data() + 4 * (i < 3 ? hit_index[i] : i);
+            out << (i == 1 ? uppercase : nouppercase) << hex << setfill('0');
+            for (int j = 0; j < 4; j++) {
+                out << setw(8) << (j == 3 && i >= 3 ? d[j] ^ 1u : d[j]);
+            }
+            out << dec << endl;
+        }
+        out.close();
+        MD5TargetSet targets;
+        bool loaded = md5_load_targets(path, targets);
+        remove(path);
+        vector<MD5Hit> hits;
+        md5_crack_batch(large_inputs.data(), large_count, targets, hits);
+        bool ok = loaded && targets.digests.size() == 5000 * 4 && hits.size() == 3;
+        for (size_t i = 0; ok && i < hits.size(); i++) {
+            ok = hits[i].index == hit_index[i];
+        }
+        cout << "md5_load_targets + 过滤器: " << (ok ? "正确" : "错误!") << endl;
+    }
+
+    // 单目标模式：逆推的快速路径必须与串行MD5Hash逐条比较的结果完全一致
+    // 输入包括各种长度的短口令（被逆推的消息字为0或不为0）、重复的口令以及多块的长口令
+    {
+        vector<string> single_inputs;
+        for (int i = 0; i < 20000; i++) {
+            single_inputs.push_back(to_string(i * 7919 % 100000));
+        }
+        for (int len = 0; len < 130; len++) {
+            single_inputs.push_back(string(len, 'a' + len % 26));
+        }
+        single_inputs.push_back("4242");
+        // 同一长度、只有开头不同：被逆推的消息字不为0但各通道相同，逆推的状态按批现算
+        for (int i = 0; i < 2000; i++) {
+            single_inputs.push_back(to_string(1000 + i) + "suffix-suffix-su");
+        }
+        int mismatches = 0;
+        for (size_t t = 0; t < single_inputs.size(); t += 997) {
+            bit32 digest[4];
+            MD5Hash(single_inputs[t], digest);
+            MD5SingleTarget target;
+            md5_prepare_single_target(digest, target);
+            vector<size_t> expect;
+            for (size_t i = 0; i < single_inputs.size(); i++) {
+                bit32 state[4];
+                MD5Hash(single_inputs[i], state);
+                if (memcmp(state, digest, sizeof(state)) == 0) {
+                    expect.push_back(i);
+                }
+            }
+            for (MD5Impl impl : impls) {
+                vector<MD5Hit> hits;
+                md5_crack_single(single_inputs.data(), single_inputs.size(), target, hits, impl);
+                bool ok = hits.size() == expect.size();
+                for (size_t i = 0; ok && i < hits.size(); i++) {
+                    ok = hits[i].index == expect[i];
+                }
+                mismatches += !ok;
+            }
+        }
+        cout << "md5_crack_single: " << (mismatches == 0 ? "与MD5Hash完全一致" : "存在不一致!") << endl;
+    }
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "PCFG.h"
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+// 编译指令如下
+// g++ correctness_guess.cpp train.cpp guessing.cpp score.cpp -o test_guess.exe -O2 -fopenmp
+//
+// 运行方式：./test_guess.exe [训练集] [读入的行数] [猜测数]
+// 验证优先队列生成的猜测流：
+// 1. 出队的PT概率单调不增，每条猜测的概率不高于它所在chunk的PT的概率
+//    因此猜测流中的概率最多只在一个chunk（LAST_SEGMENT_CHUNK条猜测）之内上升
+// 2. 对每条猜测打分（ScoreBatch），找到的是生成它的PT，概率与按它在各segment中的名次计算的概率完全相同
+// 3. 概率分带枚举（BandEnumerator）的各带合起来，与优先队列生成的猜测集合完全相同，没有重复也没有遗漏
+// 4. 蒙特卡洛猜测数估计（GuessNumberEstimator）与实际枚举得到的猜测数相符
+// 5. 设置口令策略后，生成的每条猜测都满足策略，并且满足策略的猜测一条也不少
+
+/// @brief 两个PT的结构（各segment的类型和长度）是否相同
+static bool SameShape(const PT &a, const PT &b)
+{
+    if (a.content.size() != b.content.size())
+    {
+        return false;
+    }
+    for (int i = 0; i < a.content.size(); i += 1)
+    {
+        if (a.content[i].type != b.content[i].type || a.content[i].length != b.content[i].length)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief 按口令本身（而不是生成它的PT）判断是否满足策略
+static bool PolicyAllows(const PasswordPolicy &policy, const string &pw)
+{
+    vector<Token> tokens;
+    Tokenize(pw.data(), pw.length(), tokens);
+    bool has_type[4] = {false, false, false, false};
+    for (const Token &tok : tokens)
+    {
+        has_type[tok.type] = true;
+    }
+    int classes = has_type[1] + has_type[2] + has_type[3];
+    return pw.length() >= policy.min_length && pw.length() <= policy.max_length && classes >= policy.min_classes;
+}
+
+int main(int argc, char *argv[])
+{
+    string path = argc > 1 ? argv[1] : "/guessdata/Rockyou-singleLined-full.txt";
+    long long max_lines = argc > 2 ? atoll(argv[2]) : 200000;
+    long long guess_limit = argc > 3 ? atoll(argv[3]) : 1000000;
+
+    // 取训练集的前若干行作为训练数据
+    const char *subset_path = "correctness_guess.txt";
+    long long lines = 0;
+    {
+        ifstream in(path);
+        ofstream out(subset_path);
+        string pw;
+        while (lines < max_lines && in >> pw)
+        {
+            out << pw << "\n";
+            lines += 1;
+        }
+    }
+    if (lines == 0)
+    {
+        cout << "无法读取训练集: " << path << endl;
+        remove(subset_path);
+        return 1;
+    }
+
+    PriorityQueue q;
+    q.m.train(subset_path);
+    q.m.order();
+    remove(subset_path);
+    q.init();
+
+    bool ok = true;
+
+    // 按出队顺序检查：队首PT的概率不高于上一次出队的PT，这一次生成的猜测的概率都不高于队首PT
+    // PT的概率是float，比较时留出float的舍入误差
+    bool monotone = true;
+    bool bounded = true;
+    bool scored = true;
+    float last_prob = INFINITY;
+    vector<PasswordScore> scores;
+    vector<double> probs;
+    vector<string> generated;
+    while (!q.priority.empty() && q.total_guesses < guess_limit)
+    {
+        PT front = q.priority.front();
+        monotone = monotone && front.prob <= last_prob;
+        last_prob = front.prob;
+        q.guesses.clear();
+        q.PopNext();
+        scores.resize(q.guesses.size());
+        q.m.ScoreBatch(q.guesses.data(), q.guesses.size(), scores.data());
+
+        // 第i条猜测取最后一个segment中名次为curr_indices[last]+i的value，其余segment取curr_indices中的value
+        // 按与Score相同的顺序累乘各segment的概率，结果应与打分完全相同
+        int last = front.content.size() - 1;
+        double prefix_prob = 1;
+        for (int i = 0; i < last; i += 1)
+        {
+            const SegmentStats *seg = q.m.GetSegment(front.content[i].type, front.content[i].length);
+            prefix_prob *= seg->freq(front.curr_indices[i]) / seg->total_freq;
+        }
+        const SegmentStats *tail = q.m.GetSegment(front.content[last].type, front.content[last].length);
+        for (size_t i = 0; i < q.guesses.size(); i += 1)
+        {
+            const PasswordScore &score = scores[i];
+            bounded = bounded && score.pt >= 0 && score.prob <= front.prob * (1 + 1e-5);
+            double value_prob = prefix_prob * (tail->freq(front.curr_indices[last] + i) / tail->total_freq);
+            scored = scored && score.pt >= 0 && SameShape(q.m.ordered_pts[score.pt], front) && score.prob == front.preterm_prob * value_prob;
+            probs.push_back(score.prob);
+            generated.emplace_back(move(q.guesses[i]));
+        }
+    }
+    cout << "出队顺序（" << q.total_guesses << "条猜测）: " << (monotone && bounded ? "概率单调不增" : "概率上升超过一个chunk!") << endl;
+    cout << "猜测打分: " << (scored ? "与生成时的概率完全一致" : "存在不一致!") << endl;
+    ok = ok && monotone && bounded && scored;
+
+    // 队首PT的概率是所有尚未生成的猜测的概率上界，因此概率高于它的口令已经全部枚举到了
+    double bound = q.priority.empty() ? 0 : q.priority.front().prob * (1 + 1e-5);
+
+    // 分带枚举的概率与Score的计算方式完全一致，因此第0..k个带合起来恰好是概率不低于lower(k)的全部口令
+    // 取lower(k)高于上界的所有带（队列已空时取全部count()个带），与优先队列生成的猜测中概率不低于lower(k)的部分比较
+    BandEnumerator bands(q.m);
+    vector<string> band_guesses;
+    int band_count = 0;
+    while (band_count < bands.count() && bands.lower(band_count) > bound)
+    {
+        bands.enumerate(band_count, band_guesses);
+        band_count += 1;
+    }
+    vector<string> queue_guesses;
+    for (size_t i = 0; band_count > 0 && i < generated.size(); i += 1)
+    {
+        if (probs[i] >= bands.lower(band_count - 1))
+        {
+            queue_guesses.push_back(generated[i]);
+        }
+    }
+    sort(band_guesses.begin(), band_guesses.end());
+    sort(queue_guesses.begin(), queue_guesses.end());
+    bool unique_bands = adjacent_find(band_guesses.begin(), band_guesses.end()) == band_guesses.end();
+    bool same_set = unique_bands && band_guesses == queue_guesses;
+    cout << "分带枚举（" << band_count << "个带，" << band_guesses.size() << "条猜测）: " << (same_set ? "与优先队列的猜测集合完全一致" : (unique_bands ? "与优先队列的猜测集合不一致!" : "存在重复的猜测!")) << endl;
+    ok = ok && band_count > 0 && same_set;
+
+    // 对概率高于上界的阈值，实际猜测数就是已生成的猜测中概率高于阈值的条数
+    // 阈值取在两个不同的概率之间，避免并列的概率在不同的乘法顺序下因舍入误差落到阈值的两侧
+    sort(probs.begin(), probs.end(), greater<double>());
+    GuessNumberEstimator estimator;
+    estimator.build(q.m, 1000000, 1);
+    bool estimated = true;
+    for (size_t rank = 100; rank < probs.size(); rank *= 10)
+    {
+        size_t count = rank;
+        while (count < probs.size() && probs[count] >= probs[count - 1] * (1 - 1e-9))
+        {
+            count += 1;
+        }
+        if (count >= probs.size() || probs[count] <= bound)
+        {
+            break;
+        }
+        double threshold = (probs[count - 1] + probs[count]) / 2;
+        double low, high;
+        double guess_number = estimator.estimate(threshold, &low, &high);
+        cout << "概率 > " << threshold << ": 实际猜测数 " << count << ", 估计 " << guess_number << " [" << low << ", " << high << "]" << endl;
+        // 估计落在实际值的5%以内，或实际值落在95%置信区间内
+        estimated = estimated && (fabs(guess_number - count) <= 0.05 * count || (low <= count && count <= high));
+    }
+    cout << "猜测数估计: " << (estimated ? "与枚举结果相符" : "与枚举结果不符!") << endl;
+    ok = ok && estimated;
+
+    // 口令策略：同一个模型，设置策略后重新生成，直到队首的概率低于无策略时停止的位置
+    // 这样两次生成都包含了概率高于上界的全部（满足策略的）口令，可以逐条比较
+    PasswordPolicy policy;
+    policy.min_length = 7;
+    policy.max_length = 12;
+    policy.min_classes = 2;
+    PriorityQueue p;
+    p.m = q.m;
+    p.policy = policy;
+    p.init();
+    bool obeyed = true;
+    vector<string> policy_guesses;
+    while (!p.priority.empty() && (q.priority.empty() || p.priority.front().prob >= q.priority.front().prob))
+    {
+        p.guesses.clear();
+        p.PopNext();
+        scores.resize(p.guesses.size());
+        p.m.ScoreBatch(p.guesses.data(), p.guesses.size(), scores.data());
+        for (size_t i = 0; i < p.guesses.size(); i += 1)
+        {
+            obeyed = obeyed && PolicyAllows(policy, p.guesses[i]);
+            if (scores[i].prob > bound)
+            {
+                policy_guesses.push_back(p.guesses[i]);
+            }
+        }
+    }
+    vector<string> allowed_guesses;
+    for (const string &guess : generated)
+    {
+        PasswordScore score;
+        if (PolicyAllows(policy, guess) && q.m.Score(guess.data(), guess.length(), score) && score.prob > bound)
+        {
+            allowed_guesses.push_back(guess);
+        }
+    }
+    sort(policy_guesses.begin(), policy_guesses.end());
+    sort(allowed_guesses.begin(), allowed_guesses.end());
+    bool complete = policy_guesses == allowed_guesses;
+    cout << "口令策略（" << policy_guesses.size() << "条猜测）: " << (obeyed ? (complete ? "全部满足策略，且没有遗漏" : "遗漏了满足策略的猜测!") : "生成了不满足策略的猜测!") << endl;
+    ok = ok && obeyed && complete;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+#include "PCFG.h"
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+using namespace std;
+
+// 编译指令如下
+// g++ correctness_train.cpp train.cpp train_external.cpp train_heavy.cpp guessing.cpp score.cpp -o test_train.exe -O2 -fopenmp
+//
+// 运行方式：./test_train.exe [训练集] [读入的行数]
+// 验证几种训练方式得到的模型与内存训练完全一致：
+// 1. 外存训练（内存预算很小，会溢写出多个run并多趟归并）
+// 2. heavy hitter训练，计数器容量不小于口令数时计数是精确的
+// 3. compact(1.0, ..., false)不舍弃任何value和PT，也不改变任何口令的打分；有损压缩后不留下任何PT都不引用的segment
+// 4. 由去重计数的训练集（每行"出现次数\t口令"）训练，即train_counted
+// 5. 按需排序（多次ensure_ordered）得到的名次与一次性全部排序完全相同
+// 前四项的一致性用Score检验：训练集中的每个口令，以及一些训练集中没有的口令
+
+/// @brief 比较两个模型对同一批口令的打分
+/// @return 打分不一致的口令数
+static int CompareScores(const model &expect, const model &actual, const vector<string> &pws)
+{
+    int mismatches = 0;
+    for (const string &pw : pws)
+    {
+        PasswordScore a, b;
+        bool found_a = expect.Score(pw.data(), pw.length(), a);
+        bool found_b = actual.Score(pw.data(), pw.length(), b);
+        if (found_a != found_b || a.preterm_prob != b.preterm_prob || fabs(a.prob - b.prob) > 1e-12 * a.prob)
+        {
+            mismatches += 1;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+    string path = argc > 1 ? argv[1] : "/guessdata/Rockyou-singleLined-full.txt";
+    long long max_lines = argc > 2 ? atoll(argv[2]) : 200000;
+
+    // 取训练集的前若干行，内存训练最多读入三百万行，各种训练方式读入的口令完全相同
+    const char *subset_path = "correctness_train.txt";
+    vector<string> pws;
+    {
+        ifstream in(path);
+        ofstream out(subset_path);
+        string pw;
+        while (pws.size() < max_lines && in >> pw)
+        {
+            pws.push_back(pw);
+            out << pw << "\n";
+        }
+    }
+    if (pws.empty())
+    {
+        cout << "无法读取训练集: " << path << endl;
+        remove(subset_path);
+        return 1;
+    }
+    // 训练集中没有的口令：大多数的PT存在而value不存在，也有PT不存在的
+    vector<string> queries = pws;
+    for (size_t i = 0; i < pws.size(); i += 97)
+    {
+        queries.push_back(pws[i] + "9z");
+        queries.push_back("~" + pws[i]);
+    }
+
+    model mem;
+    mem.train(subset_path);
+    mem.order();
+
+    bool ok = true;
+
+    // 按需排序：模拟生成猜测时逐步增长的请求，排好全部value后，名次应与按频数一次性稳定排序
+    // （频数相同时按首次出现的顺序）的结果完全相同
+    model lazy = mem;
+    bool same_ranks = true;
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? lazy.letters : (type == 2 ? lazy.digits : lazy.symbols);
+        for (SegmentStats &seg : segs)
+        {
+            vector<long long> freqs = seg.freqs;
+            vector<int> ids(seg.value_count());
+            for (int id = 0; id < ids.size(); id += 1)
+            {
+                ids[id] = id;
+            }
+            stable_sort(ids.begin(), ids.end(), [&freqs](int a, int b)
+                        { return freqs[a] > freqs[b]; });
+            for (int n = 1; n < seg.value_count(); n = n * 3 + 1)
+            {
+                seg.ensure_ordered(n);
+            }
+            seg.finish_order();
+            for (int rank = 0; same_ranks && rank < ids.size(); rank += 1)
+            {
+                same_ranks = memcmp(seg.value(rank), seg.values.key(ids[rank]), seg.length) == 0 && seg.freq(rank) == freqs[ids[rank]];
+            }
+        }
+    }
+    cout << "按需排序: " << (same_ranks ? "与一次性全部排序的名次完全一致" : "名次不一致!") << endl;
+    ok = ok && same_ranks;
+
+    model ext;
+    bool trained = ext.train_external(subset_path, 1 << 16, ".");
+    ext.order();
+    int mismatches = trained ? CompareScores(mem, ext, queries) : -1;
+    cout << "外存训练: " << (mismatches == 0 ? "与内存训练完全一致" : "存在不一致!") << endl;
+    ok = ok && mismatches == 0;
+
+    model heavy;
+    heavy.train_heavy_hitters(subset_path, pws.size(), pws.size());
+    heavy.order();
+    mismatches = CompareScores(mem, heavy, queries);
+    cout << "heavy hitter训练（满容量）: " << (mismatches == 0 ? "与内存训练完全一致" : "存在不一致!") << endl;
+    ok = ok && mismatches == 0;
+
+    // 无损压缩：value和PT的数目不变，舍弃的质量为0，打分不变
+    model compacted = mem;
+    double lost = compacted.compact(1.0, 1 << 30, 1 << 30, false);
+    bool same_size = compacted.ordered_pts.size() == mem.ordered_pts.size() && compacted.letters.size() == mem.letters.size()
+        && compacted.digits.size() == mem.digits.size() && compacted.symbols.size() == mem.symbols.size();
+    for (int type = 1; type <= 3; type += 1)
+    {
+        const vector<SegmentStats> &before = type == 1 ? mem.letters : (type == 2 ? mem.digits : mem.symbols);
+        const vector<SegmentStats> &after = type == 1 ? compacted.letters : (type == 2 ? compacted.digits : compacted.symbols);
+        for (int i = 0; same_size && i < before.size(); i += 1)
+        {
+            same_size = before[i].value_count() == after[i].value_count() && before[i].total_freq == after[i].total_freq;
+        }
+    }
+    mismatches = CompareScores(mem, compacted, queries);
+    bool lossless = same_size && lost < 1e-6 && mismatches == 0;
+    cout << "compact(1.0, 不量化): " << (lossless ? "无损" : "有损失!") << endl;
+    ok = ok && lossless;
+
+    // 有损压缩只保留少数PT：剩下的每个segment都被某个PT引用，每个PT的segment都能按索引找到，
+    // 保留下来的PT生成的口令仍然可以打分
+    model lossy = mem;
+    lossy.compact(0.9, 1000, 20, true);
+    int referenced = 0;
+    bool resolvable = true;
+    for (const PT &pt : lossy.ordered_pts)
+    {
+        for (const SegmentShape &shape : pt.content)
+        {
+            const SegmentStats *seg = lossy.GetSegment(shape.type, shape.length);
+            resolvable = resolvable && seg != nullptr && seg->type == shape.type && seg->length == shape.length;
+        }
+    }
+    for (int type = 1; type <= 3; type += 1)
+    {
+        const vector<SegmentStats> &segs = type == 1 ? lossy.letters : (type == 2 ? lossy.digits : lossy.symbols);
+        for (const SegmentStats &seg : segs)
+        {
+            bool used = false;
+            for (int i = 0; !used && i < lossy.ordered_pts.size(); i += 1)
+            {
+                for (const SegmentShape &shape : lossy.ordered_pts[i].content)
+                {
+                    used = used || (shape.type == seg.type && shape.length == seg.length);
+                }
+            }
+            referenced += used;
+            resolvable = resolvable && used;
+        }
+    }
+    for (const string &pw : pws)
+    {
+        PasswordScore a, b;
+        if (mem.Score(pw.data(), pw.length(), a) && a.pt < lossy.ordered_pts.size())
+        {
+            // 保留的PT及其value仍然存在时，打分不会失败；value被舍弃时返回false
+            lossy.Score(pw.data(), pw.length(), b);
+            resolvable = resolvable && b.pt == a.pt;
+        }
+    }
+    cout << "compact(0.9, 有损): 保留" << lossy.ordered_pts.size() << "个PT和" << referenced << "个segment, "
+         << (resolvable ? "没有多余的segment" : "segment与PT不一致!") << endl;
+    ok = ok && resolvable;
+
+    // 去重计数：按首次出现的顺序写出每个口令及其出现次数
+    const char *counted_path = "correctness_train_counted.txt";
+    {
+        unordered_map<string, long long> counts;
+        vector<string> unique_pws;
+        for (const string &pw : pws)
+        {
+            if (counts[pw]++ == 0)
+            {
+                unique_pws.push_back(pw);
+            }
+        }
+        ofstream out(counted_path);
+        for (const string &pw : unique_pws)
+        {
+            out << counts[pw] << "\t" << pw << "\n";
+        }
+    }
+    model counted;
+    counted.train_counted(counted_path);
+    counted.order();
+    remove(counted_path);
+    mismatches = CompareScores(mem, counted, queries);
+    bool same_pts = counted.ordered_pts.size() == mem.ordered_pts.size() && counted.total_preterm == mem.total_preterm;
+    cout << "去重计数训练: " << (same_pts && mismatches == 0 ? "与内存训练完全一致" : "存在不一致!") << endl;
+    ok = ok && same_pts && mismatches == 0;
+
+    remove(subset_path);
+    return ok ? 0 : 1;
+}
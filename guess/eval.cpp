@@ -0,0 +1,118 @@
+#include "PCFG.h"
+#include <fstream>
+#include <cmath>
+using namespace std;
+
+// 测试集评估：生成的每一批猜测在清空之前与测试集比较，不需要把猜测写到文件再事后统计
+
+// 并行检查时每个分块的猜测数
+#define EVAL_CHUNK 4096
+
+bool TestSetEvaluator::load(const string &path)
+{
+    ifstream test_set(path);
+    if (!test_set)
+    {
+        return false;
+    }
+    string pw;
+    while (getline(test_set, pw))
+    {
+        if (!pw.empty() && pw.back() == '\r')
+        {
+            pw.pop_back();
+        }
+        if (pw.empty())
+        {
+            continue;
+        }
+        auto it = index.find(pw);
+        if (it == index.end())
+        {
+            index.emplace(pw, multiplicity.size());
+            multiplicity.push_back(1);
+        }
+        else
+        {
+            multiplicity[it->second] += 1;
+        }
+        total += 1;
+    }
+    cracked.assign(multiplicity.size(), 0);
+    return true;
+}
+
+void TestSetEvaluator::advance_checkpoint()
+{
+    // 记录点取 10^(k/10) 取整后去重：1, 2, 3, 4, 5, 6, 8, 10, 13, 16, 20, 25, ...
+    while (true)
+    {
+        next_point += 1;
+        size_t point = size_t(llround(pow(10.0, next_point / 10.0)));
+        if (point > next_checkpoint)
+        {
+            next_checkpoint = point;
+            return;
+        }
+    }
+}
+
+void TestSetEvaluator::check(const vector<string> &batch)
+{
+    // 各分块独立查表，命中记录为(在batch中的下标, 命中数)，分块内按下标有序
+    int chunks = (batch.size() + EVAL_CHUNK - 1) / EVAL_CHUNK;
+    vector<vector<pair<size_t, int>>> chunk_hits(chunks);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunks; c += 1)
+    {
+        size_t end = min(batch.size(), size_t(c + 1) * EVAL_CHUNK);
+        for (size_t i = size_t(c) * EVAL_CHUNK; i < end; i += 1)
+        {
+            auto it = index.find(batch[i]);
+            if (it != index.end() && __atomic_exchange_n(&cracked[it->second], 1, __ATOMIC_RELAXED) == 0)
+            {
+                chunk_hits[c].emplace_back(i, multiplicity[it->second]);
+            }
+        }
+    }
+
+    // 按生成顺序合并，经过记录点时记下当时的累计命中数
+    size_t base = guesses;
+    for (const vector<pair<size_t, int>> &list : chunk_hits)
+    {
+        for (const pair<size_t, int> &hit : list)
+        {
+            while (next_checkpoint <= base + hit.first)
+            {
+                curve.emplace_back(next_checkpoint, hits);
+                advance_checkpoint();
+            }
+            hits += hit.second;
+        }
+    }
+    guesses = base + batch.size();
+    while (next_checkpoint <= guesses)
+    {
+        curve.emplace_back(next_checkpoint, hits);
+        advance_checkpoint();
+    }
+}
+
+bool TestSetEvaluator::write_curve(const string &path) const
+{
+    ofstream out(path);
+    if (!out)
+    {
+        return false;
+    }
+    double denom = total > 0 ? total : 1;
+    for (const pair<size_t, size_t> &point : curve)
+    {
+        out << point.first << "\t" << point.second << "\t" << point.second / denom << "\n";
+    }
+    if (curve.empty() || curve.back().first != guesses)
+    {
+        out << guesses << "\t" << hits << "\t" << hits / denom << "\n";
+    }
+    return true;
+}
@@ -7,35 +7,230 @@ using namespace std;
 using namespace chrono;
 
 // 编译指令如下
-// g++ main.cpp train.cpp guessing.cpp md5.cpp -o main
-// g++ main.cpp train.cpp guessing.cpp md5.cpp -o main -O1
-// g++ main.cpp train.cpp guessing.cpp md5.cpp -o main -O2
+// g++ main.cpp train.cpp train_external.cpp train_heavy.cpp guessing.cpp score.cpp eval.cpp md5.cpp -o main
+// g++ main.cpp train.cpp train_external.cpp train_heavy.cpp guessing.cpp score.cpp eval.cpp md5.cpp -o main -O1
+// g++ main.cpp train.cpp train_external.cpp train_heavy.cpp guessing.cpp score.cpp eval.cpp md5.cpp -o main -O2
+// g++ main.cpp train.cpp train_external.cpp train_heavy.cpp guessing.cpp score.cpp eval.cpp md5.cpp -o main -O2 -fopenmp（md5_batch使用多线程）
+//
+// 运行方式：./main               只生成并哈希口令，比较串行与SIMD的哈希时间
+//          ./main targets.txt   破解模式，targets.txt每行一条十六进制MD5，只输出命中的口令
+//          ./main -e test.txt [curve.txt]
+//                               评估模式，生成过程中统计测试集的命中情况，结束时写出命中曲线（默认curve.txt）
+//          ./main -s passwords.txt
+//                               打分模式，不生成猜测，输出文件中每条口令在模型下的概率（模型无法生成时为0）
+//          ./main -g passwords.txt [samples]
+//                               猜测数估计模式，在打分模式的基础上用samples条抽样（默认100万）估计每条口令的猜测数及其95%置信区间
+//
+// 以下选项可以出现在任意位置：
+//          --counted counts.txt 从去重计数的训练集（每行"出现次数\t口令"）训练，代替默认的训练集，对所有模式有效
+// 以下选项对生成猜测的模式（性能测试、破解、评估）有效：
+//          --bands              按概率分带枚举（BandEnumerator）依次生成各带的猜测，代替优先队列
+//          --min-len N          口令策略：只生成长度不小于N的口令
+//          --max-len N          口令策略：只生成长度不大于N的口令
+//          --classes N          口令策略：只生成至少包含N类字符（字母、数字、特殊字符）的口令
 
-int main()
+// 破解模式：在核心中直接与目标摘要比较，输出命中的口令，返回命中数
+static size_t CrackGuesses(const vector<string> &guesses, const MD5TargetSet &targets, const MD5SingleTarget &single_target)
+{
+    vector<MD5Hit> hits;
+    // 只有一个目标时使用单目标模式，逆推最后几步以提前拒绝
+    if (targets.digests.size() == 4)
+    {
+        md5_crack_single(guesses.data(), guesses.size(), single_target, hits);
+    }
+    else
+    {
+        md5_crack_batch(guesses.data(), guesses.size(), targets, hits);
+    }
+    for (const MD5Hit &hit : hits)
+    {
+        cout << "Cracked: " << guesses[hit.index] << " ";
+        for (int j = 0; j < 4; j++)
+        {
+            cout << setw(8) << setfill('0') << hex << hit.digest[j];
+        }
+        cout << dec << endl;
+    }
+    return hits.size();
+}
+
+// 打分模式：对文件中的每一行口令打分，每行输出"口令\t概率"
+// estimator非空时（猜测数估计模式）每行再输出"\t估计猜测数\t置信下界\t置信上界"
+static int ScorePasswords(const model &m, const char *path, const GuessNumberEstimator *estimator = nullptr)
+{
+    vector<PasswordScore> scores;
+    if (!m.ScoreFile(path, scores))
+    {
+        cout << "无法打开口令文件: " << path << endl;
+        return 1;
+    }
+    // ScoreFile按行给出打分结果，这里再按行读一遍口令用于输出
+    ifstream in(path);
+    string pw;
+    size_t found = 0;
+    for (size_t i = 0; i < scores.size() && getline(in, pw); i += 1)
+    {
+        if (!pw.empty() && pw.back() == '\r')
+        {
+            pw.pop_back();
+        }
+        cout << pw << "\t" << scores[i].prob;
+        if (estimator != nullptr)
+        {
+            double low, high;
+            double guess_number = estimator->estimate(scores[i].prob, &low, &high);
+            cout << "\t" << guess_number << "\t" << low << "\t" << high;
+        }
+        cout << "\n";
+        found += scores[i].pt >= 0 && scores[i].prob > 0;
+    }
+    cout << "模型可生成的口令: " << found << "/" << scores.size() << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
     double time_hash = 0;         // 总哈希时间
     double time_hash_serial = 0;  // 串行哈希累计时间
     double time_hash_simd = 0;    // 并行哈希累计时间
     double time_guess = 0;        // 哈希和猜测的总时长
     double time_train = 0;        // 模型训练的总时长
+
+    // 取出以"--"开头的选项，其余参数保持原来的顺序，按位置解析
+    bool band_mode = false;
+    string counted_path;
+    PasswordPolicy policy;
+    int positional = 1;
+    for (int i = 1; i < argc; i += 1)
+    {
+        string arg = argv[i];
+        if (arg == "--bands")
+        {
+            band_mode = true;
+        }
+        else if (arg == "--counted" && i + 1 < argc)
+        {
+            counted_path = argv[i + 1];
+            i += 1;
+        }
+        else if ((arg == "--min-len" || arg == "--max-len" || arg == "--classes") && i + 1 < argc)
+        {
+            int value = atoi(argv[i + 1]);
+            i += 1;
+            if (arg == "--min-len")
+            {
+                policy.min_length = value;
+            }
+            else if (arg == "--max-len")
+            {
+                policy.max_length = value;
+            }
+            else
+            {
+                policy.min_classes = value;
+            }
+        }
+        else
+        {
+            argv[positional] = argv[i];
+            positional += 1;
+        }
+    }
+    argc = positional;
+
     PriorityQueue q;
     auto start_train = system_clock::now();
-    q.m.train("/guessdata/Rockyou-singleLined-full.txt");
+    if (counted_path.empty())
+    {
+        q.m.train("/guessdata/Rockyou-singleLined-full.txt");
+    }
+    else
+    {
+        q.m.train_counted(counted_path);
+    }
     q.m.order();
     auto end_train = system_clock::now();
     auto duration_train = duration_cast<microseconds>(end_train - start_train);
     time_train = double(duration_train.count()) * microseconds::period::num / microseconds::period::den;
 
-    q.init();
+    if (argc > 2 && string(argv[1]) == "-s")
+    {
+        return ScorePasswords(q.m, argv[2]);
+    }
+    if (argc > 2 && string(argv[1]) == "-g")
+    {
+        GuessNumberEstimator estimator;
+        estimator.build(q.m, argc > 3 ? atoll(argv[3]) : 1000000);
+        return ScorePasswords(q.m, argv[2], &estimator);
+    }
+
+    // 评估模式：载入测试集，生成的猜测不再哈希，而是直接与测试集比较
+    bool eval_mode = argc > 2 && string(argv[1]) == "-e";
+    string curve_path = argc > 3 ? argv[3] : "curve.txt";
+    TestSetEvaluator evaluator;
+    if (eval_mode)
+    {
+        if (!evaluator.load(argv[2]))
+        {
+            cout << "无法打开测试集: " << argv[2] << endl;
+            return 1;
+        }
+        cout << "测试集口令数: " << evaluator.total << endl;
+    }
+
+    // 破解模式：载入目标摘要
+    bool crack_mode = argc > 1 && !eval_mode;
+    MD5TargetSet targets;
+    MD5SingleTarget single_target;
+    size_t total_hits = 0;
+    if (crack_mode)
+    {
+        if (!md5_load_targets(argv[1], targets))
+        {
+            cout << "无法打开目标文件: " << argv[1] << endl;
+            return 1;
+        }
+        cout << "目标摘要数: " << targets.digests.size() / 4 << endl;
+        if (targets.digests.size() == 4)
+        {
+            md5_prepare_single_target(targets.digests.data(), single_target);
+        }
+    }
+
+    // 分带模式不使用优先队列，按带的序号依次生成
+    BandEnumerator *bands = nullptr;
+    int band = 0;
+    int band_count = 0;
+    if (band_mode)
+    {
+        bands = new BandEnumerator(q.m);
+        bands->policy = policy;
+        band_count = bands->count();
+    }
+    else
+    {
+        q.policy = policy;
+        q.init();
+    }
     cout << "here" << endl;
+    // md5_batch第一次调用时会实测选择实现（可能是NEON+标量的混合内核），放在计时之外完成
+    cout << "MD5实现: " << md5_impl_name(md5_select_impl()) << endl;
     int curr_num = 0;
     auto start = system_clock::now();
     // 由于需要定期清空内存，我们在这里记录已生成的猜测总数
     int history = 0;
     // std::ofstream a("./files/results.txt");
-    while (!q.priority.empty())
+    while (band_mode ? band < band_count : !q.priority.empty())
     {
-        q.PopNext();
+        if (band_mode)
+        {
+            bands->enumerate(band, q.guesses);
+            band += 1;
+        }
+        else
+        {
+            q.PopNext();
+        }
         q.total_guesses = q.guesses.size();
         if (q.total_guesses - curr_num >= 100000)
         {
@@ -50,16 +245,43 @@ int main()
                 auto duration = duration_cast<microseconds>(end - start);
                 time_guess = double(duration.count()) * microseconds::period::num / microseconds::period::den;
                 cout << "Guess time:" << time_guess - time_hash << "seconds"<< endl;
-                cout << "Hash time (serial):" << time_hash_serial << "seconds"<<endl;
-                cout << "Hash time (SIMD):" << time_hash_simd << "seconds"<<endl;
-                cout << "Hash speedup:" << time_hash_serial / time_hash_simd << "x" << endl;
+                if (crack_mode)
+                {
+                    cout << "Hash time:" << time_hash << "seconds" << endl;
+                }
+                else
+                {
+                    cout << "Hash time (serial):" << time_hash_serial << "seconds"<<endl;
+                    cout << "Hash time (SIMD):" << time_hash_simd << "seconds"<<endl;
+                    cout << "Hash speedup:" << time_hash_serial / time_hash_simd << "x" << endl;
+                }
                 cout << "Train time:" << time_train <<"seconds"<<endl;
                 break;
             }
         }
         // 为了避免内存超限，我们在q.guesses中口令达到一定数目时，将其中的所有口令取出并且进行哈希
         // 然后，q.guesses将会被清空。为了有效记录已经生成的口令总数，维护一个history变量来进行记录
-        if (curr_num > 1000000)
+        if (curr_num > 1000000 && eval_mode)
+        {
+            evaluator.check(q.guesses);
+            history += curr_num;
+            curr_num = 0;
+            q.guesses.clear();
+        }
+        else if (curr_num > 1000000 && crack_mode)
+        {
+            // 破解模式只用批量接口，不再运行串行版本，猜测直接从q.guesses传入，不再拷贝
+            auto start_hash = system_clock::now();
+            total_hits += CrackGuesses(q.guesses, targets, single_target);
+            auto end_hash = system_clock::now();
+            auto duration = duration_cast<microseconds>(end_hash - start_hash);
+            time_hash += double(duration.count()) * microseconds::period::num / microseconds::period::den;
+
+            history += curr_num;
+            curr_num = 0;
+            q.guesses.clear();
+        }
+        else if (curr_num > 1000000)
         {
             auto start_hash = system_clock::now();
             
@@ -90,29 +312,18 @@ int main()
                 passwords[idx++] = pw;
             }
             
-            // 3. 使用对齐内存分配哈希结果数组 - 提高SIMD性能
-            bit32** hash_results = new bit32*[pw_count];
-            for (size_t i = 0; i < pw_count; i++) {
-                // 16字节对齐的内存分配（SIMD要求）
-                void* ptr = nullptr;
-                if (posix_memalign(&ptr, 16, 4 * sizeof(bit32)) != 0) {
-                    hash_results[i] = new bit32[4];
-                } else {
-                    hash_results[i] = static_cast<bit32*>(ptr);
-                }
+            // 3. 使用连续的对齐数组保存哈希结果，第i条口令的结果位于hash_results[4*i..4*i+3]
+            bit32* hash_results = nullptr;
+            if (posix_memalign((void**)&hash_results, 64, pw_count * 4 * sizeof(bit32)) != 0) {
+                hash_results = static_cast<bit32*>(malloc(pw_count * 4 * sizeof(bit32)));
             }
             
-            // 4. 调用SIMD版本进行批量计算 - 充分利用SIMD指令
-            MD5Hash_SIMD(passwords, pw_count, hash_results);
+            // 4. 调用统一的批量接口，由md5_batch根据CPU选择实现并处理尾部
+            md5_batch(passwords, pw_count, hash_results);
             
             // 5. 释放分配的内存
             delete[] passwords;
-            for (size_t i = 0; i < pw_count; i++) {
-                if (hash_results[i]) {
-                    free(hash_results[i]);  // 使用free释放对齐内存
-                }
-            }
-            delete[] hash_results;
+            free(hash_results);
             
             // 计算SIMD版本时间并累加
             auto end_simd = system_clock::now();
@@ -137,4 +348,18 @@ int main()
             q.guesses.clear();
         }
     }
+    if (eval_mode)
+    {
+        // 检查尚未检查的最后一批猜测，然后写出命中曲线
+        evaluator.check(q.guesses);
+        evaluator.write_curve(curve_path);
+        cout << "Test set hits:" << evaluator.hits << "/" << evaluator.total << endl;
+    }
+    if (crack_mode)
+    {
+        // 破解尚未破解的最后一批猜测（达到猜测上限或队列为空时剩下的）
+        total_hits += CrackGuesses(q.guesses, targets, single_target);
+        cout << "Cracked:" << total_hits << endl;
+    }
+    delete bands;
 }
\ No newline at end of file
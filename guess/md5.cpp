@@ -1,7 +1,14 @@
 #include "md5.h"
+#include "md5_core.h"
 #include <iomanip>
 #include <assert.h>
 #include <chrono>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
 
 using namespace std;
 using namespace chrono;
@@ -27,7 +34,8 @@ Byte *StringProcess(string input, int *n_byte)
 	int paddingBits = bitLength % 512;
 	if (paddingBits > 448)
 	{
-		paddingBits += 512 - (paddingBits - 448);
+		// 先补到下一个512bit边界，再补448bit（原先多加了一次paddingBits，长度模64为57~63字节的消息会得到错误的填充长度）
+		paddingBits = 512 - paddingBits + 448;
 	}
 	else if (paddingBits < 448)
 	{
@@ -67,7 +75,7 @@ Byte *StringProcess(string input, int *n_byte)
 
 	// 验证长度是否满足要求。此时长度应当是512bit的倍数
 	int residual = 8 * paddedLength % 512;
-	// assert(residual == 0);
+	assert(residual == 0);
 
 	// 在填充+添加长度之后，消息被分为n_blocks个512bit的部分
 	*n_byte = paddedLength;
@@ -83,331 +91,290 @@ Byte *StringProcess(string input, int *n_byte)
  */
 void MD5Hash(string input, bit32 *state)
 {
+	int messageLength;
+	Byte *paddedMessage = StringProcess(input, &messageLength);
+	int n_blocks = messageLength / 64;
 
-	Byte *paddedMessage;
-	int *messageLength = new int[1];
-	for (int i = 0; i < 1; i += 1)
-	{
-		paddedMessage = StringProcess(input, &messageLength[i]);
-		// cout<<messageLength[i]<<endl;
-		assert(messageLength[i] == messageLength[0]);
-	}
-	int n_blocks = messageLength[0] / 64;
-
-	// bit32* state= new bit32[4];
-	state[0] = 0x67452301;
-	state[1] = 0xefcdab89;
-	state[2] = 0x98badcfe;
-	state[3] = 0x10325476;
-
-	// 逐block地更新state
-	for (int i = 0; i < n_blocks; i += 1)
-	{
-		bit32 x[16];
-
-		// 下面的处理，在理解上较为复杂
-		for (int i1 = 0; i1 < 16; ++i1)
-		{
-			x[i1] = (paddedMessage[4 * i1 + i * 64]) |
-					(paddedMessage[4 * i1 + 1 + i * 64] << 8) |
-					(paddedMessage[4 * i1 + 2 + i * 64] << 16) |
-					(paddedMessage[4 * i1 + 3 + i * 64] << 24);
-		}
-
-		bit32 a = state[0], b = state[1], c = state[2], d = state[3];
-
-		auto start = system_clock::now();
-		/* Round 1 */
-		FF(a, b, c, d, x[0], s11, 0xd76aa478);
-		FF(d, a, b, c, x[1], s12, 0xe8c7b756);
-		FF(c, d, a, b, x[2], s13, 0x242070db);
-		FF(b, c, d, a, x[3], s14, 0xc1bdceee);
-		FF(a, b, c, d, x[4], s11, 0xf57c0faf);
-		FF(d, a, b, c, x[5], s12, 0x4787c62a);
-		FF(c, d, a, b, x[6], s13, 0xa8304613);
-		FF(b, c, d, a, x[7], s14, 0xfd469501);
-		FF(a, b, c, d, x[8], s11, 0x698098d8);
-		FF(d, a, b, c, x[9], s12, 0x8b44f7af);
-		FF(c, d, a, b, x[10], s13, 0xffff5bb1);
-		FF(b, c, d, a, x[11], s14, 0x895cd7be);
-		FF(a, b, c, d, x[12], s11, 0x6b901122);
-		FF(d, a, b, c, x[13], s12, 0xfd987193);
-		FF(c, d, a, b, x[14], s13, 0xa679438e);
-		FF(b, c, d, a, x[15], s14, 0x49b40821);
-
-		/* Round 2 */
-		GG(a, b, c, d, x[1], s21, 0xf61e2562);
-		GG(d, a, b, c, x[6], s22, 0xc040b340);
-		GG(c, d, a, b, x[11], s23, 0x265e5a51);
-		GG(b, c, d, a, x[0], s24, 0xe9b6c7aa);
-		GG(a, b, c, d, x[5], s21, 0xd62f105d);
-		GG(d, a, b, c, x[10], s22, 0x2441453);
-		GG(c, d, a, b, x[15], s23, 0xd8a1e681);
-		GG(b, c, d, a, x[4], s24, 0xe7d3fbc8);
-		GG(a, b, c, d, x[9], s21, 0x21e1cde6);
-		GG(d, a, b, c, x[14], s22, 0xc33707d6);
-		GG(c, d, a, b, x[3], s23, 0xf4d50d87);
-		GG(b, c, d, a, x[8], s24, 0x455a14ed);
-		GG(a, b, c, d, x[13], s21, 0xa9e3e905);
-		GG(d, a, b, c, x[2], s22, 0xfcefa3f8);
-		GG(c, d, a, b, x[7], s23, 0x676f02d9);
-		GG(b, c, d, a, x[12], s24, 0x8d2a4c8a);
-
-		/* Round 3 */
-		HH(a, b, c, d, x[5], s31, 0xfffa3942);
-		HH(d, a, b, c, x[8], s32, 0x8771f681);
-		HH(c, d, a, b, x[11], s33, 0x6d9d6122);
-		HH(b, c, d, a, x[14], s34, 0xfde5380c);
-		HH(a, b, c, d, x[1], s31, 0xa4beea44);
-		HH(d, a, b, c, x[4], s32, 0x4bdecfa9);
-		HH(c, d, a, b, x[7], s33, 0xf6bb4b60);
-		HH(b, c, d, a, x[10], s34, 0xbebfbc70);
-		HH(a, b, c, d, x[13], s31, 0x289b7ec6);
-		HH(d, a, b, c, x[0], s32, 0xeaa127fa);
-		HH(c, d, a, b, x[3], s33, 0xd4ef3085);
-		HH(b, c, d, a, x[6], s34, 0x4881d05);
-		HH(a, b, c, d, x[9], s31, 0xd9d4d039);
-		HH(d, a, b, c, x[12], s32, 0xe6db99e5);
-		HH(c, d, a, b, x[15], s33, 0x1fa27cf8);
-		HH(b, c, d, a, x[2], s34, 0xc4ac5665);
-
-		/* Round 4 */
-		II(a, b, c, d, x[0], s41, 0xf4292244);
-		II(d, a, b, c, x[7], s42, 0x432aff97);
-		II(c, d, a, b, x[14], s43, 0xab9423a7);
-		II(b, c, d, a, x[5], s44, 0xfc93a039);
-		II(a, b, c, d, x[12], s41, 0x655b59c3);
-		II(d, a, b, c, x[3], s42, 0x8f0ccc92);
-		II(c, d, a, b, x[10], s43, 0xffeff47d);
-		II(b, c, d, a, x[1], s44, 0x85845dd1);
-		II(a, b, c, d, x[8], s41, 0x6fa87e4f);
-		II(d, a, b, c, x[15], s42, 0xfe2ce6e0);
-		II(c, d, a, b, x[6], s43, 0xa3014314);
-		II(b, c, d, a, x[13], s44, 0x4e0811a1);
-		II(a, b, c, d, x[4], s41, 0xf7537e82);
-		II(d, a, b, c, x[11], s42, 0xbd3af235);
-		II(c, d, a, b, x[2], s43, 0x2ad7d2bb);
-		II(b, c, d, a, x[9], s44, 0xeb86d391);
-
-		state[0] += a;
-		state[1] += b;
-		state[2] += c;
-		state[3] += d;
-	}
-
-	// 下面的处理，在理解上较为复杂
-	for (int i = 0; i < 4; i++)
-	{
-		uint32_t value = state[i];
-		state[i] = ((value & 0xff) << 24) |		 // 将最低字节移到最高位
-				   ((value & 0xff00) << 8) |	 // 将次低字节左移
-				   ((value & 0xff0000) >> 8) |	 // 将次高字节右移
-				   ((value & 0xff000000) >> 24); // 将最高字节移到最低位
-	}
-
-	// 输出最终的hash结果
-	// for (int i1 = 0; i1 < 4; i1 += 1)
-	// {
-	// 	cout << std::setw(8) << std::setfill('0') << hex << state[i1];
-	// }
-	// cout << endl;
+	// 标量版本与SIMD版本共用md5_core.h中的64步调度，只是向量宽度为1
+	MD5HashLanes<ScalarOps, 1>(&paddedMessage, &n_blocks, 1, state);
 
 	// 释放动态分配的内存
 	// 实现SIMD并行算法的时候，也请记得及时回收内存！
-	delete[] paddedMessage;
-	delete[] messageLength;
+	free(paddedMessage);
 }
 
-void MD5Hash_SIMD(const string* inputs, size_t input_count, bit32** states) {
-    // 一次处理4个输入（SIMD宽度）
-    const size_t simd_width = 4;
-    
-    // 按SIMD宽度分批处理所有输入
-    for (size_t batch = 0; batch < input_count; batch += simd_width) {
-        // 确定当前批次实际处理的输入数量（可能不足simd_width个）
-        size_t current_batch_size = min(simd_width, input_count - batch);
-        
-        // 为当前批次的输入预处理消息
-        Byte* paddedMessages[simd_width];
-        int messageLengths[simd_width];
-        int n_blocks[simd_width];
-        
-        // 预处理每个输入
-        for (size_t i = 0; i < current_batch_size; i++) {
-            paddedMessages[i] = StringProcess(inputs[batch + i], &messageLengths[i]);
-            n_blocks[i] = messageLengths[i] / 64;
+void MD5Hash_SIMD(const string* inputs, size_t input_count, bit32** states, int ways) {
+    // 分段预处理，避免一次性为全部输入分配填充缓冲区
+    const size_t chunk = 1024;
+    Byte* paddedMessages[chunk];
+    int n_blocks[chunk];
+    alignas(16) static thread_local bit32 digests[chunk * 4];
+
+    for (size_t base = 0; base < input_count; base += chunk) {
+        size_t n = min(chunk, input_count - base);
+        for (size_t i = 0; i < n; i++) {
+            int messageLength;
+            paddedMessages[i] = StringProcess(inputs[base + i], &messageLength);
+            n_blocks[i] = messageLength / 64;
         }
-        
-        // 初始化SIMD向量以同时计算4个哈希
-        uint32x4_t state0 = vdupq_n_u32(0x67452301);
-        uint32x4_t state1 = vdupq_n_u32(0xefcdab89);
-        uint32x4_t state2 = vdupq_n_u32(0x98badcfe);
-        uint32x4_t state3 = vdupq_n_u32(0x10325476);
-        
-        // 找出最大的块数以确保处理所有数据
-        int max_blocks = 0;
-        for (size_t i = 0; i < current_batch_size; i++) {
-            if (n_blocks[i] > max_blocks) {
-                max_blocks = n_blocks[i];
-            }
+
+        // 交错路数越多，隐藏延迟的效果越好，但寄存器压力也越大
+        // AArch64有32个128位寄存器，3路（12条消息）时x、状态和临时值仍可基本放在寄存器中
+        MD5HashMessages<NeonOps>(paddedMessages, n_blocks, n, digests, ways);
+
+        // 保存每个哈希结果，并释放内存
+        for (size_t i = 0; i < n; i++) {
+            memcpy(states[base + i], digests + 4 * i, 4 * sizeof(bit32));
+            free(paddedMessages[i]);
         }
-        
-        // 逐块处理
-        for (int block = 0; block < max_blocks; block++) {
-            // 准备当前块的SIMD数据
-            uint32x4_t x[16];
-            
-            // 为每个消息准备16个x数组值 - 4路循环展开
-			for (int j = 0; j < 16; j += 4) {
-				alignas(16) uint32_t values0[4] = {0}, values1[4] = {0}, values2[4] = {0}, values3[4] = {0};
-				
-				// 预取下一批将使用的数据(如果j+4<16)
-				if (j + 4 < 16) {
-					for (size_t i = 0; i < current_batch_size; i++) {
-						if (block < n_blocks[i]) {
-							// 预取J+4, J+5, J+6, J+7的数据
-							__builtin_prefetch(&paddedMessages[i][4*(j+4) + block*64], 0);
-							__builtin_prefetch(&paddedMessages[i][4*(j+5) + block*64], 0);
-							__builtin_prefetch(&paddedMessages[i][4*(j+6) + block*64], 0);
-							__builtin_prefetch(&paddedMessages[i][4*(j+7) + block*64], 0);
-						}
-					}
-				}
-				
-				// 优化数据加载 - 尝试使用32位直接加载
-				for (size_t i = 0; i < current_batch_size; i++) {
-					if (block < n_blocks[i]) {
-						// 检查是否可以使用32位加载(内存对齐)
-						uintptr_t addr0 = (uintptr_t)&paddedMessages[i][4*j + block*64];
-						uintptr_t addr1 = (uintptr_t)&paddedMessages[i][4*(j+1) + block*64];
-						uintptr_t addr2 = (uintptr_t)&paddedMessages[i][4*(j+2) + block*64];
-						uintptr_t addr3 = (uintptr_t)&paddedMessages[i][4*(j+3) + block*64];
-						
-						// 对齐的32位加载更高效
-						values0[i] = *(uint32_t*)&paddedMessages[i][4*j + block*64];
-						values1[i] = *(uint32_t*)&paddedMessages[i][4*(j+1) + block*64];
-						values2[i] = *(uint32_t*)&paddedMessages[i][4*(j+2) + block*64];
-						values3[i] = *(uint32_t*)&paddedMessages[i][4*(j+3) + block*64];
-					}
-				}
-				
-				// SIMD寄存器加载保持不变
-				x[j] = vld1q_u32(values0);
-				x[j+1] = vld1q_u32(values1);
-				x[j+2] = vld1q_u32(values2);
-				x[j+3] = vld1q_u32(values3);
-			}
-            
-            // 保存当前状态以便后续更新
-            uint32x4_t a = state0;
-            uint32x4_t b = state1;
-            uint32x4_t c = state2;
-            uint32x4_t d = state3;
-            
-            /* 使用SIMD宏执行Round 1 */
-            FF_SIMD(a, b, c, d, x[0], s11, 0xd76aa478);
-            FF_SIMD(d, a, b, c, x[1], s12, 0xe8c7b756);
-            FF_SIMD(c, d, a, b, x[2], s13, 0x242070db);
-            FF_SIMD(b, c, d, a, x[3], s14, 0xc1bdceee);
-            FF_SIMD(a, b, c, d, x[4], s11, 0xf57c0faf);
-            FF_SIMD(d, a, b, c, x[5], s12, 0x4787c62a);
-            FF_SIMD(c, d, a, b, x[6], s13, 0xa8304613);
-            FF_SIMD(b, c, d, a, x[7], s14, 0xfd469501);
-            FF_SIMD(a, b, c, d, x[8], s11, 0x698098d8);
-            FF_SIMD(d, a, b, c, x[9], s12, 0x8b44f7af);
-            FF_SIMD(c, d, a, b, x[10], s13, 0xffff5bb1);
-            FF_SIMD(b, c, d, a, x[11], s14, 0x895cd7be);
-            FF_SIMD(a, b, c, d, x[12], s11, 0x6b901122);
-            FF_SIMD(d, a, b, c, x[13], s12, 0xfd987193);
-            FF_SIMD(c, d, a, b, x[14], s13, 0xa679438e);
-            FF_SIMD(b, c, d, a, x[15], s14, 0x49b40821);
-            
-            /* 使用SIMD宏执行Round 2 */
-            GG_SIMD(a, b, c, d, x[1], s21, 0xf61e2562);
-            GG_SIMD(d, a, b, c, x[6], s22, 0xc040b340);
-            GG_SIMD(c, d, a, b, x[11], s23, 0x265e5a51);
-            GG_SIMD(b, c, d, a, x[0], s24, 0xe9b6c7aa);
-            GG_SIMD(a, b, c, d, x[5], s21, 0xd62f105d);
-            GG_SIMD(d, a, b, c, x[10], s22, 0x2441453);
-            GG_SIMD(c, d, a, b, x[15], s23, 0xd8a1e681);
-            GG_SIMD(b, c, d, a, x[4], s24, 0xe7d3fbc8);
-            GG_SIMD(a, b, c, d, x[9], s21, 0x21e1cde6);
-            GG_SIMD(d, a, b, c, x[14], s22, 0xc33707d6);
-            GG_SIMD(c, d, a, b, x[3], s23, 0xf4d50d87);
-            GG_SIMD(b, c, d, a, x[8], s24, 0x455a14ed);
-            GG_SIMD(a, b, c, d, x[13], s21, 0xa9e3e905);
-            GG_SIMD(d, a, b, c, x[2], s22, 0xfcefa3f8);
-            GG_SIMD(c, d, a, b, x[7], s23, 0x676f02d9);
-            GG_SIMD(b, c, d, a, x[12], s24, 0x8d2a4c8a);
-            
-            /* 使用SIMD宏执行Round 3 */
-            HH_SIMD(a, b, c, d, x[5], s31, 0xfffa3942);
-            HH_SIMD(d, a, b, c, x[8], s32, 0x8771f681);
-            HH_SIMD(c, d, a, b, x[11], s33, 0x6d9d6122);
-            HH_SIMD(b, c, d, a, x[14], s34, 0xfde5380c);
-            HH_SIMD(a, b, c, d, x[1], s31, 0xa4beea44);
-            HH_SIMD(d, a, b, c, x[4], s32, 0x4bdecfa9);
-            HH_SIMD(c, d, a, b, x[7], s33, 0xf6bb4b60);
-            HH_SIMD(b, c, d, a, x[10], s34, 0xbebfbc70);
-            HH_SIMD(a, b, c, d, x[13], s31, 0x289b7ec6);
-            HH_SIMD(d, a, b, c, x[0], s32, 0xeaa127fa);
-            HH_SIMD(c, d, a, b, x[3], s33, 0xd4ef3085);
-            HH_SIMD(b, c, d, a, x[6], s34, 0x4881d05);
-            HH_SIMD(a, b, c, d, x[9], s31, 0xd9d4d039);
-            HH_SIMD(d, a, b, c, x[12], s32, 0xe6db99e5);
-            HH_SIMD(c, d, a, b, x[15], s33, 0x1fa27cf8);
-            HH_SIMD(b, c, d, a, x[2], s34, 0xc4ac5665);
-            
-            /* 使用SIMD宏执行Round 4 */
-            II_SIMD(a, b, c, d, x[0], s41, 0xf4292244);
-            II_SIMD(d, a, b, c, x[7], s42, 0x432aff97);
-            II_SIMD(c, d, a, b, x[14], s43, 0xab9423a7);
-            II_SIMD(b, c, d, a, x[5], s44, 0xfc93a039);
-            II_SIMD(a, b, c, d, x[12], s41, 0x655b59c3);
-            II_SIMD(d, a, b, c, x[3], s42, 0x8f0ccc92);
-            II_SIMD(c, d, a, b, x[10], s43, 0xffeff47d);
-            II_SIMD(b, c, d, a, x[1], s44, 0x85845dd1);
-            II_SIMD(a, b, c, d, x[8], s41, 0x6fa87e4f);
-            II_SIMD(d, a, b, c, x[15], s42, 0xfe2ce6e0);
-            II_SIMD(c, d, a, b, x[6], s43, 0xa3014314);
-            II_SIMD(b, c, d, a, x[13], s44, 0x4e0811a1);
-            II_SIMD(a, b, c, d, x[4], s41, 0xf7537e82);
-            II_SIMD(d, a, b, c, x[11], s42, 0xbd3af235);
-            II_SIMD(c, d, a, b, x[2], s43, 0x2ad7d2bb);
-            II_SIMD(b, c, d, a, x[9], s44, 0xeb86d391);
-            
-            // 并行累加状态
-            state0 = vaddq_u32(state0, a);
-            state1 = vaddq_u32(state1, b);
-            state2 = vaddq_u32(state2, c);
-            state3 = vaddq_u32(state3, d);
+    }
+}
+
+// 批量接口默认的交错路数
+#define MD5_BATCH_WAYS 2
+
+MD5Impl md5_select_impl()
+{
+    static const MD5Impl selected = []() {
+#if defined(__ARM_NEON)
+#if defined(__aarch64__) && defined(__linux__)
+        // AArch64上ASIMD是基本要求，这里仍然按HWCAP检查，以防在不支持的模拟环境中运行
+        if (!(getauxval(AT_HWCAP) & HWCAP_ASIMD))
+            return MD5_IMPL_SCALAR;
+#endif
+        const MD5Impl candidates[] = {MD5_IMPL_NEON, MD5_IMPL_NEON_SCALAR1, MD5_IMPL_NEON_SCALAR2};
+        return MD5Autotune(candidates, 3, [](const string *inputs, size_t count, bit32 *digests, MD5Impl impl) {
+            md5_batch(inputs, count, digests, impl);
+        });
+#else
+        return MD5_IMPL_SCALAR;
+#endif
+    }();
+    return selected;
+}
+
+const char *md5_impl_name(MD5Impl impl)
+{
+    switch (impl)
+    {
+    case MD5_IMPL_NEON:
+        return "NEON";
+    case MD5_IMPL_NEON_SCALAR1:
+        return "NEON+1标量";
+    case MD5_IMPL_NEON_SCALAR2:
+        return "NEON+2标量";
+    default:
+        return "scalar";
+    }
+}
+
+void md5_batch(const string *inputs, size_t count, bit32 *digests, MD5Impl impl)
+{
+    switch (impl)
+    {
+#if defined(__ARM_NEON)
+    case MD5_IMPL_NEON:
+        MD5HashBatch<NeonOps>(inputs, count, digests, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_NEON_SCALAR1:
+        MD5HashBatch<NeonOps>(inputs, count, digests, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_NEON_SCALAR2:
+        MD5HashBatch<NeonOps>(inputs, count, digests, MD5_BATCH_WAYS, 2);
+        break;
+#endif
+    default:
+        MD5HashBatch<ScalarOps>(inputs, count, digests, 1);
+        break;
+    }
+}
+
+void md5_batch(const string *inputs, size_t count, bit32 *digests)
+{
+    md5_batch(inputs, count, digests, md5_select_impl());
+}
+
+void md5_build_targets(const bit32 *digests, size_t count, MD5TargetSet &targets, int bits_per_key)
+{
+    vector<array<bit32, 4>> sorted(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(sorted[i].data(), digests + 4 * i, sizeof(sorted[i]));
+    }
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+
+    targets.digests.resize(sorted.size() * 4);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        memcpy(targets.digests.data() + 4 * i, sorted[i].data(), sizeof(sorted[i]));
+    }
+
+    // 核心中的状态字还没有做字节序调整，第一级比较直接使用调整前的形式
+    targets.first_words.clear();
+    targets.filter.clear();
+    targets.filter_blocks = 0;
+    if (sorted.size() <= MD5_CRACK_BROADCAST_MAX)
+    {
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            targets.first_words.push_back(__builtin_bswap32(sorted[i][0]));
         }
-        
-        // 字节序调整（将小端序转换为大端序）
-        state0 = ByteSwapSIMD(state0);
-        state1 = ByteSwapSIMD(state1);
-        state2 = ByteSwapSIMD(state2);
-        state3 = ByteSwapSIMD(state3);
-        
-        // 将结果存储到输出数组
-        uint32_t state0_arr[4], state1_arr[4], state2_arr[4], state3_arr[4];
-        vst1q_u32(state0_arr, state0);
-        vst1q_u32(state1_arr, state1);
-        vst1q_u32(state2_arr, state2);
-        vst1q_u32(state3_arr, state3);
-        
-        // 保存每个哈希结果
-        for (size_t i = 0; i < current_batch_size; i++) {
-            states[batch + i][0] = state0_arr[i];
-            states[batch + i][1] = state1_arr[i];
-            states[batch + i][2] = state2_arr[i];
-            states[batch + i][3] = state3_arr[i];
+        sort(targets.first_words.begin(), targets.first_words.end());
+        targets.first_words.erase(unique(targets.first_words.begin(), targets.first_words.end()), targets.first_words.end());
+        return;
+    }
+
+    // 每块256位
+    size_t blocks = (sorted.size() * bits_per_key + 255) / 256;
+    targets.filter_blocks = (bit32)(blocks > 0 ? blocks : 1);
+    targets.filter.assign(8 * (size_t)targets.filter_blocks, 0);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        MD5FilterInsert(targets.filter.data(), targets.filter_blocks, __builtin_bswap32(sorted[i][0]));
+    }
+}
+
+// 把32个十六进制字符解码为与MD5Hash输出相同字节序的4个bit32，含有非十六进制字符时返回false
+// 每次用一个128位寄存器处理16个字符：分别按数字和字母（大小写合并）计算半字节的值，再把相邻的两个半字节拼成一个字节
+static bool DecodeHexDigest(const char *hex, bit32 *digest)
+{
+    alignas(16) Byte bytes[16];
+#if defined(__ARM_NEON)
+    // vld2q_u8把偶数位置（高半字节）和奇数位置（低半字节）的字符分别装入两个寄存器
+    uint8x16x2_t chars = vld2q_u8((const uint8_t *)hex);
+    uint8x16_t nibbles[2];
+    uint8x16_t valid = vdupq_n_u8(0xff);
+    for (int k = 0; k < 2; k++)
+    {
+        uint8x16_t c = chars.val[k];
+        uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+        uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+        uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+        valid = vandq_u8(valid, vorrq_u8(is_digit, is_alpha));
+        nibbles[k] = vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+    }
+    if (vminvq_u8(valid) != 0xff)
+        return false;
+    vst1q_u8(bytes, vorrq_u8(vshlq_n_u8(nibbles[0], 4), nibbles[1]));
+#elif defined(__SSE2__)
+    __m128i packed[2];
+    for (int k = 0; k < 2; k++)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i *)(hex + 16 * k));
+        __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+        // 有符号比较：0x80以上的字节是负数，不会落在任何一个范围中
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+        __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff)
+            return false;
+        __m128i v = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                                 _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+        // 每个16位通道中低字节是高半字节、高字节是低半字节，合并后的字节放在低8位
+        packed[k] = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00f0)), _mm_srli_epi16(v, 8));
+    }
+    _mm_store_si128((__m128i *)bytes, _mm_packus_epi16(packed[0], packed[1]));
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        int v[2];
+        for (int k = 0; k < 2; k++)
+        {
+            char c = hex[2 * i + k];
+            v[k] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (v[k] < 0)
+                return false;
         }
-        
-        // 释放内存
-        for (size_t i = 0; i < current_batch_size; i++) {
-            free(paddedMessages[i]);
+        bytes[i] = v[0] << 4 | v[1];
+    }
+#endif
+    for (int r = 0; r < 4; r++)
+    {
+        digest[r] = (bit32)bytes[4 * r] << 24 | bytes[4 * r + 1] << 16 | bytes[4 * r + 2] << 8 | bytes[4 * r + 3];
+    }
+    return true;
+}
+
+bool md5_load_targets(const string &path, MD5TargetSet &targets, int bits_per_key)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    vector<bit32> digests;
+    bit32 digest[4];
+    const char *p = text.data(), *end = text.data() + text.size();
+    while (p < end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+        if (eol - p >= 32 && DecodeHexDigest(p, digest))
+        {
+            digests.insert(digests.end(), digest, digest + 4);
         }
+        p = eol + 1;
     }
+    md5_build_targets(digests.data(), digests.size() / 4, targets, bits_per_key);
+    return true;
 }
 
+void md5_prepare_single_target(const bit32 *digest, MD5SingleTarget &target)
+{
+    memcpy(target.digest, digest, sizeof(target.digest));
+    const bit32 zero[16] = {0};
+    MD5ReverseState(digest, zero, target.reversed_zero);
+    md5_build_targets(digest, 1, target.set);
+}
+
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits,
+                     MD5Impl impl)
+{
+    switch (impl)
+    {
+#if defined(__ARM_NEON)
+    case MD5_IMPL_NEON:
+        MD5CrackBatch<NeonOps>(inputs, count, targets, hits, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_NEON_SCALAR1:
+        MD5CrackBatch<NeonOps>(inputs, count, targets, hits, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_NEON_SCALAR2:
+        MD5CrackBatch<NeonOps>(inputs, count, targets, hits, MD5_BATCH_WAYS, 2);
+        break;
+#endif
+    default:
+        MD5CrackBatch<ScalarOps>(inputs, count, targets, hits, 1);
+        break;
+    }
+}
+
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits)
+{
+    md5_crack_batch(inputs, count, targets, hits, md5_select_impl());
+}
+
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits,
+                      MD5Impl impl)
+{
+    switch (impl)
+    {
+#if defined(__ARM_NEON)
+    case MD5_IMPL_NEON:
+    case MD5_IMPL_NEON_SCALAR1:
+    case MD5_IMPL_NEON_SCALAR2:
+        MD5CrackSingleBatch<NeonOps>(inputs, count, target, hits, MD5_BATCH_WAYS);
+        break;
+#endif
+    default:
+        MD5CrackSingleBatch<ScalarOps>(inputs, count, target, hits, 1);
+        break;
+    }
+}
+
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits)
+{
+    md5_crack_single(inputs, count, target, hits, md5_select_impl());
+}
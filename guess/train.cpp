@@ -2,6 +2,13 @@
 #include <fstream>
 #include <cctype>
 #include <algorithm>
+#include <cstring>
+#include <climits>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // 这个文件里面的各函数你都不需要完全理解，甚至根本不需要看
 // 从学术价值上讲，加速模型的训练过程是一个没什么价值的问题，因为我们一般假定统计学模型的训练成本较低
@@ -18,14 +25,48 @@
  * 
  */
 
+// 训练集的去重计数。ValueMap的条目按第一次出现的顺序编号，这样各PT/segment/value的id分配顺序与逐行parse完全一致
+// ValueMap的值只有int，因此映射值为条目编号，次数另存在counts中
+struct PasswordCounts
+{
+    ValueMap passwords;
+    vector<long long> counts;
+    long long total = 0;
+
+    void add(const string &pw, long long count)
+    {
+        bool inserted;
+        int id = passwords.find_or_insert(pw.data(), pw.length(), counts.size(), inserted);
+        if (inserted)
+        {
+            counts.emplace_back(0);
+        }
+        counts[id] += count;
+        total += count;
+    }
+};
+
+/// @brief 按去重后的口令训练：每个不同的口令只parse一次，其出现次数作为权重
+static void TrainUnique(model &m, const PasswordCounts &counts)
+{
+    cout << "Total passwords: " << counts.total << ", unique: " << counts.passwords.size() << endl;
+    cout << "Training phase 1b: parsing unique passwords..." << endl;
+    for (int i = 0; i < counts.passwords.size(); i += 1)
+    {
+        m.parse(string(counts.passwords.key(i), counts.passwords.key_length(i)), counts.counts[i]);
+    }
+}
+
 // 训练的wrapper，实际上就是读取训练集
+// 口令先在哈希表中去重计数，再对每个不同的口令parse一次，因此parse的工作量只与不同口令的数目有关
 void model::train(string path)
 {
     string pw;
     ifstream train_set(path);
     int lines = 0;
+    PasswordCounts counts;
     cout<<"Training..."<<endl;
-    cout<<"Training phase 1: reading and parsing passwords..."<<endl;
+    cout<<"Training phase 1: reading and counting passwords..."<<endl;
     while (train_set >> pw)
     {
         lines += 1;
@@ -38,9 +79,26 @@ void model::train(string path)
                 break;
             }
         }
-        // 读取单个口令之后，就可以将其扔进parse函数进行PT/segment的分割、识别、统计了
-        parse(pw);
+        counts.add(pw, 1);
+    }
+    // 去重之后，就可以将每个口令扔进parse函数进行PT/segment的分割、识别、统计了
+    TrainUnique(*this, counts);
+}
+
+// 从已经聚合好的训练集训练，每行为"出现次数\t口令"
+void model::train_counted(string path)
+{
+    string pw;
+    long long count;
+    ifstream train_set(path);
+    PasswordCounts counts;
+    cout<<"Training..."<<endl;
+    cout<<"Training phase 1: reading aggregated passwords..."<<endl;
+    while (train_set >> count >> pw)
+    {
+        counts.add(pw, count);
     }
+    TrainUnique(*this, counts);
 }
 
 /// @brief 在模型中找到一个PT的统计数据
@@ -77,7 +135,7 @@ int model::FindPT(PT pt)
 /// @brief 在模型中找到一个letter segment的统计数据
 /// @param seg 要找的letter segment
 /// @return 目标letter segment的对应下标
-int model::FindLetter(segment seg)
+int model::FindLetter(SegmentShape seg)
 {
     for (int id = 0; id < letters.size(); id += 1)
     {
@@ -92,7 +150,7 @@ int model::FindLetter(segment seg)
 /// @brief 在模型中找到一个digit segment的统计数据
 /// @param seg 要找的digit segment
 /// @return 目标digit segment的对应下标
-int model::FindDigit(segment seg)
+int model::FindDigit(SegmentShape seg)
 {
     for (int id = 0; id < digits.size(); id += 1)
     {
@@ -104,7 +162,7 @@ int model::FindDigit(segment seg)
     return -1;
 }
 
-int model::FindSymbol(segment seg)
+int model::FindSymbol(SegmentShape seg)
 {
     for (int id = 0; id < symbols.size(); id += 1)
     {
@@ -116,304 +174,386 @@ int model::FindSymbol(segment seg)
     return -1;
 }
 
-void PT::insert(segment seg)
+void PT::insert(SegmentShape seg)
 {
     content.emplace_back(seg);
 }
 
-void segment::insert(string value)
+void SegmentStats::insert(const char *value, long long count)
 {
-    if (values.find(value) == values.end())
+    // 一次查找完成查找或插入，新value的id就是它在freqs中的下标
+    bool inserted;
+    int id = values.find_or_insert(value, length, freqs.size(), inserted);
+    if (inserted)
     {
-        values[value] = values.size();
-        freqs[values[value]] = 1;
+        freqs.emplace_back(count);
     }
     else
     {
-        freqs[values[value]] += 1;
+        freqs[id] += count;
     }
 }
 
 
-void segment::order()
+// 元素数不少于这个值时才使用多线程排序和填表，否则线程的启动开销得不偿失
+#define PARALLEL_SORT_MIN (1 << 16)
+
+/// @brief 多线程排序：分成若干块各自排序，再逐轮两两归并
+/// @param less 必须是全序，这样结果与std::sort完全相同
+template <typename Iter, typename Less>
+static void ParallelSort(Iter begin, Iter end, Less less)
 {
-    for (pair<string, int> value : values)
+    size_t n = end - begin;
+    int blocks = omp_get_max_threads();
+    if (n < PARALLEL_SORT_MIN || blocks == 1 || omp_in_parallel())
     {
-        ordered_values.emplace_back(value.first);
+        sort(begin, end, less);
+        return;
     }
-    // cout << "value size:" << ordered_values.size() << endl;
-    std::sort(ordered_values.begin(), ordered_values.end(),
-              [this](const std::string &a, const std::string &b)
-              {
-                  return freqs.at(values[a]) > freqs.at(values[b]);
-              });
+    vector<size_t> bounds(blocks + 1);
+    for (int b = 0; b <= blocks; b += 1)
+    {
+        bounds[b] = n * b / blocks;
+    }
+#pragma omp parallel for schedule(static, 1)
+    for (int b = 0; b < blocks; b += 1)
+    {
+        sort(begin + bounds[b], begin + bounds[b + 1], less);
+    }
+    // 每轮把相邻的两块归并为一块，块数减半
+    for (int width = 1; width < blocks; width *= 2)
+    {
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blocks - width; b += 2 * width)
+        {
+            int right = min(blocks, b + 2 * width);
+            inplace_merge(begin + bounds[b], begin + bounds[b + width], begin + bounds[right], less);
+        }
+    }
+}
 
-    // 将排序后的频率存入 ordered_freqs 并计算 total_freq
-    for (const std::string &val : ordered_values)
+void SegmentStats::order()
+{
+    // 已经排好序（例如外存训练直接建立了有序的表）
+    if (ordered_count() > 0)
     {
-        ordered_freqs.emplace_back(freqs.at(values[val]));
-        total_freq += freqs.at(values[val]);
+        return;
     }
-    for (string val : ordered_values)
+    total_freq = 0;
+    for (long long freq : freqs)
     {
-        ordered_freqs.emplace_back(freqs.at(values[val]));
-        total_freq += freqs.at(values[val]);
+        total_freq += freq;
     }
 }
 
-void model::parse(string pw)
+void SegmentStats::ensure_ordered(int n)
 {
-    PT pt;
-    string curr_part = "";
-    int curr_type = 0; // 0: 未设置, 1: 字母, 2: 数字, 3: 特殊字符
-    // 请学会使用这种方式写for循环：for (auto it : iterable)
-    // 相信我，以后你会用上的。You're welcome :)
-    for (char ch : pw)
+    int done = ordered_count();
+    int total = value_count();
+    if (n <= done || done == total)
     {
-        if (isalpha(ch))
+        return;
+    }
+    if (done == 0)
+    {
+        // 第一次排序：所有id都待排序
+        pending.resize(total);
+        for (int id = 0; id < total; id += 1)
         {
-            if (curr_type != 1)
+            pending[id] = id;
+        }
+    }
+
+    // 频数降序，频数相同时按id升序，这是一个全序，因此分段排序与一次性排序的结果相同
+    auto higher = [this](int a, int b)
+    {
+        return freqs[a] > freqs[b] || (freqs[a] == freqs[b] && a < b);
+    };
+    int target = min(total, max(n, max(2 * done, SEGMENT_ORDER_INITIAL)));
+    if (target < total)
+    {
+        nth_element(pending.begin() + done, pending.begin() + target, pending.end(), higher);
+    }
+    ParallelSort(pending.begin() + done, pending.begin() + target, higher);
+
+    // 把新排好的一段追加到有序表的末尾，各名次互不相关，段较长时多线程填写
+    flat_values.resize(size_t(target) * length);
+    bool pack = type == 2 && length <= 16;
+    if (pack)
+    {
+        packed_digits.resize(target);
+    }
+    ordered_freqs.resize(target);
+#pragma omp parallel for if (target - done >= PARALLEL_SORT_MIN && !omp_in_parallel())
+    for (int rank = done; rank < target; rank += 1)
+    {
+        const char *value = values.key(pending[rank]);
+        memcpy(&flat_values[size_t(rank) * length], value, length);
+        if (pack)
+        {
+            unsigned long long bcd = 0;
+            for (int i = 0; i < length; i += 1)
             {
-                if (curr_type == 2)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindDigit(seg) == -1)
-                    {
-                        int id = GetNextDigitsID();
-                        digits.emplace_back(seg);
-                        digits[id].insert(curr_part);
-                        digits_freq[id] = 1;
-                    }
-                    else
-                    {
-                        int id = FindDigit(seg);
-                        digits_freq[id] += 1;
-                        digits[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
-                else if (curr_type == 3)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindSymbol(seg) == -1)
-                    {
-                        int id = GetNextSymbolsID();
-                        symbols.emplace_back(seg);
-                        symbols_freq[id] = 1;
-                        symbols[id].insert(curr_part);
-                    }
-                    else
-                    {
-                        int id = FindSymbol(seg);
-                        symbols_freq[id] += 1;
-                        symbols[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
+                bcd |= (unsigned long long)(value[i] - '0') << (4 * i);
             }
-            curr_type = 1;
-            curr_part += ch;
+            packed_digits[rank] = bcd;
+        }
+        ordered_freqs[rank] = freqs[pending[rank]];
+    }
+
+    // 全部排好后与fill_ordered的结果一致：id改写为名次，释放排序用的临时数组
+    if (target == total)
+    {
+        for (int rank = 0; rank < total; rank += 1)
+        {
+            values.value(pending[rank]) = rank;
         }
-        else if (isdigit(ch))
+        freqs = ordered_freqs;
+        vector<int>().swap(pending);
+    }
+}
+
+void SegmentStats::fill_ordered(const vector<string> &ordered_values, const vector<long long> &counts)
+{
+    // 将排序后的频率存入 ordered_freqs 并计算 total_freq
+    ordered_freqs = counts;
+    total_freq = 0;
+    for (long long freq : counts)
+    {
+        total_freq += freq;
+    }
+
+    // 排好序的value连续定长存放；数字segment另存一份BCD压缩形式
+    flat_values.resize(ordered_values.size() * length);
+    bool pack = type == 2 && length <= 16;
+    if (pack)
+    {
+        packed_digits.resize(ordered_values.size());
+    }
+    for (int rank = 0; rank < ordered_values.size(); rank += 1)
+    {
+        memcpy(&flat_values[size_t(rank) * length], ordered_values[rank].data(), length);
+        if (pack)
         {
-            if (curr_type != 2)
+            unsigned long long bcd = 0;
+            for (int i = 0; i < length; i += 1)
             {
-                if (curr_type == 1)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindLetter(seg) == -1)
-                    {
-                        int id = GetNextLettersID();
-                        letters.emplace_back(seg);
-                        letters_freq[id] = 1;
-                        letters[id].insert(curr_part);
-                    }
-                    else
-                    {
-                        int id = FindLetter(seg);
-                        letters_freq[id] += 1;
-                        letters[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
-                else if (curr_type == 3)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindSymbol(seg) == -1)
-                    {
-                        int id = GetNextSymbolsID();
-                        symbols.emplace_back(seg);
-                        symbols_freq[id] = 1;
-                        symbols[id].insert(curr_part);
-                    }
-                    else
-                    {
-                        int id = FindSymbol(seg);
-                        symbols_freq[id] += 1;
-                        symbols[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
+                bcd |= (unsigned long long)(ordered_values[rank][i] - '0') << (4 * i);
             }
-            curr_type = 2;
-            curr_part += ch;
+            packed_digits[rank] = bcd;
         }
-        else
+    }
+
+    // 建立value到名次的映射，之后values中的映射值就是value(i)和ordered_freqs中的下标
+    values.clear();
+    values.reserve(ordered_values.size());
+    bool inserted;
+    for (int rank = 0; rank < ordered_values.size(); rank += 1)
+    {
+        values.find_or_insert(ordered_values[rank].data(), length, rank, inserted);
+    }
+    freqs = ordered_freqs;
+}
+
+/// @brief 对16个字节按字符类别分类，并求出segment边界
+/// @param p 16个字节的输入
+/// @param prev 这16个字节之前一个字节的类别，块首之前没有字节时传0，保证第一个字节总是边界
+/// @param cls 输出每个字节的类别：1字母，2数字，3特殊字符（与isalpha/isdigit在C locale下一致）
+/// @return 第i位为1表示p[i]与前一个字节类别不同，即开始一个新的segment
+static inline unsigned ClassifyBlock(const unsigned char *p, unsigned char prev, unsigned char *cls)
+{
+#if defined(__ARM_NEON)
+    uint8x16_t v = vld1q_u8(p);
+    // (c|0x20)-'a' <= 25 为字母，c-'0' <= 9 为数字，利用无符号回绕一次比较完成区间判断
+    uint8x16_t letter = vcleq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a')), vdupq_n_u8(25));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+    // 字母: 3+0xfe=1，数字: 3+0xff=2，其余为3
+    uint8x16_t c = vaddq_u8(vaddq_u8(vdupq_n_u8(3), vandq_u8(letter, vdupq_n_u8(0xfe))), digit);
+    vst1q_u8(cls, c);
+    uint8x16_t shifted = vextq_u8(vdupq_n_u8(prev), c, 15);
+    // NEON没有movemask，用按位权重求和得到16位掩码
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t diff = vandq_u8(vmvnq_u8(vceqq_u8(c, shifted)), vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(diff)) | (unsigned(vaddv_u8(vget_high_u8(diff))) << 8);
+#elif defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // x <= y 等价于 min(x, y) == x（无符号）
+    __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(25)), l);
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i c = _mm_add_epi8(_mm_add_epi8(_mm_set1_epi8(3), _mm_and_si128(letter, _mm_set1_epi8(char(0xfe)))), digit);
+    _mm_storeu_si128((__m128i *)cls, c);
+    __m128i shifted = _mm_or_si128(_mm_slli_si128(c, 1), _mm_cvtsi32_si128(prev));
+    return ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(c, shifted))) & 0xffff;
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < 16; i += 1)
+    {
+        unsigned char ch = p[i];
+        cls[i] = unsigned((ch | 0x20) - 'a') <= 25 ? 1 : (unsigned(ch - '0') <= 9 ? 2 : 3);
+        if (cls[i] != (i == 0 ? prev : cls[i - 1]))
         {
-            if (curr_type != 3)
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+void Tokenize(const char *pw, int len, vector<Token> &tokens)
+{
+    tokens.clear();
+    unsigned char prev = 0;
+    int start = -1;
+    int type = 0;
+    for (int base = 0; base < len; base += 16)
+    {
+        int n = min(16, len - base);
+        const unsigned char *p = (const unsigned char *)pw + base;
+        // 最后不足16字节时拷贝到本地缓冲区，避免越界读（mmap的文件末尾之后可能不可读）
+        unsigned char tail[16] = {0};
+        if (n < 16)
+        {
+            memcpy(tail, p, n);
+            p = tail;
+        }
+        unsigned char cls[16];
+        unsigned mask = ClassifyBlock(p, prev, cls) & ((1u << n) - 1);
+        while (mask != 0)
+        {
+            int i = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (start >= 0)
             {
-                if (curr_type == 1)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindLetter(seg) == -1)
-                    {
-                        int id = GetNextLettersID();
-                        letters.emplace_back(seg);
-                        letters_freq[id] = 1;
-                        letters[id].insert(curr_part);
-                    }
-                    else
-                    {
-                        int id = FindLetter(seg);
-                        letters_freq[id] += 1;
-                        letters[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
-                else if (curr_type == 2)
-                {
-                    segment seg(curr_type, curr_part.length());
-                    if (FindDigit(seg) == -1)
-                    {
-                        int id = GetNextDigitsID();
-                        digits.emplace_back(seg);
-                        digits_freq[id] = 1;
-                        digits[id].insert(curr_part);
-                    }
-                    else
-                    {
-                        int id = FindDigit(seg);
-                        digits_freq[id] += 1;
-                        digits[id].insert(curr_part);
-                    }
-                    curr_part.clear();
-                    pt.insert(seg);
-                }
+                tokens.push_back({type, start, base + i - start});
             }
-            curr_type = 3;
-            curr_part += ch;
+            start = base + i;
+            type = cls[i];
         }
+        prev = cls[n - 1];
     }
-    if (!curr_part.empty())
+    if (start >= 0)
     {
-        if (curr_type == 1)
+        tokens.push_back({type, start, len - start});
+    }
+}
+
+void model::parse(string pw, long long count)
+{
+    // 切分交给Tokenize完成，这里只负责统计。tokens在各次调用之间复用
+    thread_local vector<Token> tokens;
+    Tokenize(pw.data(), pw.length(), tokens);
+    if (!ShapesFit(tokens))
+    {
+        return;
+    }
+    PT pt;
+    pt.content.reserve(tokens.size());
+    // 请学会使用这种方式写for循环：for (auto it : iterable)
+    // 相信我，以后你会用上的。You're welcome :)
+    for (const Token &tok : tokens)
+    {
+        SegmentShape seg(tok.type, tok.length);
+        // value直接指向口令中的对应位置，不再单独构造字符串
+        const char *curr_part = pw.data() + tok.start;
+        if (tok.type == 1)
         {
-            segment seg(curr_type, curr_part.length());
-            if (FindLetter(seg) == -1)
+            int id = FindLetter(seg);
+            if (id == -1)
             {
-                int id = GetNextLettersID();
-                letters.emplace_back(seg);
-                letters_freq[id] = 1;
-                letters[id].insert(curr_part);
+                id = GetNextLettersID();
+                letters.emplace_back(seg.type, seg.length);
+                letters_freq.emplace_back(count);
             }
             else
             {
-                int id = FindLetter(seg);
-                letters_freq[id] += 1;
-                letters[id].insert(curr_part);
+                letters_freq[id] += count;
             }
-            curr_part.clear();
-            pt.insert(seg);
+            letters[id].insert(curr_part, count);
         }
-        else if (curr_type == 2)
+        else if (tok.type == 2)
         {
-            segment seg(curr_type, curr_part.length());
-            if (FindDigit(seg) == -1)
+            int id = FindDigit(seg);
+            if (id == -1)
             {
-                int id = GetNextDigitsID();
-                digits.emplace_back(seg);
-                digits_freq[id] = 1;
-                digits[id].insert(curr_part);
+                id = GetNextDigitsID();
+                digits.emplace_back(seg.type, seg.length);
+                digits_freq.emplace_back(count);
             }
             else
             {
-                int id = FindDigit(seg);
-                digits_freq[id] += 1;
-                digits[id].insert(curr_part);
+                digits_freq[id] += count;
             }
-            curr_part.clear();
-            pt.insert(seg);
+            digits[id].insert(curr_part, count);
         }
         else
         {
-            segment seg(curr_type, curr_part.length());
-            if (FindSymbol(seg) == -1)
+            int id = FindSymbol(seg);
+            if (id == -1)
             {
-                int id = GetNextSymbolsID();
-                symbols.emplace_back(seg);
-                symbols_freq[id] = 1;
-                symbols[id].insert(curr_part);
+                id = GetNextSymbolsID();
+                symbols.emplace_back(seg.type, seg.length);
+                symbols_freq.emplace_back(count);
             }
             else
             {
-                int id = FindSymbol(seg);
-                symbols_freq[id] += 1;
-                symbols[id].insert(curr_part);
+                symbols_freq[id] += count;
             }
-            curr_part.clear();
-            pt.insert(seg);
+            symbols[id].insert(curr_part, count);
         }
+        pt.insert(seg);
     }
     // pt.PrintPT();
     // cout<<endl;
     // cout << FindPT(pt) << endl;
-    total_preterm += 1;
-    if (FindPT(pt) == -1)
+    total_preterm += count;
+    int id = FindPT(pt);
+    if (id == -1)
     {
         for (int i = 0; i < pt.content.size(); i += 1)
         {
             pt.curr_indices.emplace_back(0);
         }
-        int id = GetNextPretermID();
+        id = GetNextPretermID();
         // cout << id << endl;
         preterminals.emplace_back(pt);
-        preterm_freq[id] = 1;
+        preterm_freq.emplace_back(count);
     }
     else
     {
-        int id = FindPT(pt);
         // cout << id << endl;
-        preterm_freq[id] += 1;
+        preterm_freq[id] += count;
     }
 }
 
-void segment::PrintSeg()
+void SegmentStats::PrintSeg()
+{
+    SegmentShape(type, length).PrintSeg();
+}
+
+void SegmentShape::PrintSeg() const
 {
     if (type == 1)
     {
-        cout << "L" << length;
+        cout << "L" << int(length);
     }
     if (type == 2)
     {
-        cout << "D" << length;
+        cout << "D" << int(length);
     }
     if (type == 3)
     {
-        cout << "S" << length;
+        cout << "S" << int(length);
     }
 }
 
-void segment::PrintValues()
+void SegmentStats::PrintValues()
 {
-    // order();
-    for (string iter : ordered_values)
+    finish_order();
+    for (int i = 0; i < value_count(); i += 1)
     {
-        cout << iter << " freq:" << freqs[values[iter]] << endl;
+        cout << string(value(i), length) << " freq:" << freq(i) << endl;
     }
 }
 
@@ -472,32 +612,305 @@ bool compareByPretermProb(const PT& a, const PT& b) {
 
 void model::order()
 {
-    cout << "Training phase 2: Ordering segment values and PTs..." << endl;
-    for (PT pt : preterminals)
+    cout << "Training phase 2: Ordering PTs and totalling segment frequencies..." << endl;
+    for (int id = 0; id < preterminals.size(); id += 1)
     {
-        pt.preterm_prob = float(preterm_freq[FindPT(pt)]) / total_preterm;
+        PT pt = preterminals[id];
+        pt.preterm_prob = float(preterm_freq[id]) / total_preterm;
         ordered_pts.emplace_back(pt);
     }
     bool swapped;
     cout << "total pts" << ordered_pts.size() << endl;
     std::sort(ordered_pts.begin(), ordered_pts.end(), compareByPretermProb);
-    cout << "Ordering letters" << endl;
+    cout << "Totalling letters (values are ordered lazily while guessing)" << endl;
     // cout << "total letters" << endl;
     for (int i = 0; i < letters.size(); i += 1)
     {
         // cout << i << endl;
         letters[i].order();
     }
-    cout << "Ordering digits" << endl;
+    cout << "Totalling digits (values are ordered lazily while guessing)" << endl;
     // cout << "total letters" << endl;
     for (int i = 0; i < digits.size(); i += 1)
     {
         digits[i].order();
     }
-    cout << "ordering symbols" << endl;
+    cout << "Totalling symbols (values are ordered lazily while guessing)" << endl;
     // cout << "total letters" << endl;
     for (int i = 0; i < symbols.size(); i += 1)
     {
         symbols[i].order();
     }
-}
\ No newline at end of file
+
+    // 建立打分用的查找表
+    letters_index.clear();
+    digits_index.clear();
+    symbols_index.clear();
+    for (int i = 0; i < letters.size(); i += 1)
+    {
+        letters_index.resize(max<int>(letters_index.size(), letters[i].length + 1), -1);
+        letters_index[letters[i].length] = i;
+    }
+    for (int i = 0; i < digits.size(); i += 1)
+    {
+        digits_index.resize(max<int>(digits_index.size(), digits[i].length + 1), -1);
+        digits_index[digits[i].length] = i;
+    }
+    for (int i = 0; i < symbols.size(); i += 1)
+    {
+        symbols_index.resize(max<int>(symbols_index.size(), symbols[i].length + 1), -1);
+        symbols_index[symbols[i].length] = i;
+    }
+    pt_index.clear();
+    for (int i = 0; i < ordered_pts.size(); i += 1)
+    {
+        string key;
+        for (const SegmentShape &seg : ordered_pts[i].content)
+        {
+            AppendShapeKey(key, seg.type, seg.length);
+        }
+        pt_index[key] = i;
+    }
+}
+
+void model::ensure_ordered(int n)
+{
+    // 各segment互不相关，作为独立的任务并行排序
+    // 较大的segment逐个处理，由ParallelSort在内部并行；其余的segment之间并行，每个segment单线程排序
+    vector<SegmentStats *> large, small;
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+        for (SegmentStats &seg : segs)
+        {
+            int todo = min(n, seg.value_count()) - seg.ordered_count();
+            if (todo <= 0)
+            {
+                continue;
+            }
+            (todo >= PARALLEL_SORT_MIN ? large : small).push_back(&seg);
+        }
+    }
+    for (SegmentStats *seg : large)
+    {
+        seg->ensure_ordered(n);
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < small.size(); i += 1)
+    {
+        small[i]->ensure_ordered(n);
+    }
+}
+
+void model::finish_order()
+{
+    ensure_ordered(INT_MAX);
+}
+
+const SegmentStats *model::GetSegment(int type, int length) const
+{
+    const vector<int> &index = type == 1 ? letters_index : (type == 2 ? digits_index : symbols_index);
+    const vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+    if (length >= index.size() || index[length] == -1)
+    {
+        return nullptr;
+    }
+    return &segs[index[length]];
+}
+/// @brief 压缩一个segment：只保留前若干个value，并可选地把频数量化为16位对数
+/// @return 保留下来的value在原segment中的概率质量
+static double CompactSegment(SegmentStats &seg, double mass, int max_rank, bool quantize)
+{
+    seg.finish_order();
+    int n = seg.value_count();
+    double total = seg.total_freq;
+    // 按频数降序累加，直到达到mass或max_rank，至少保留一个value
+    // mass >= 1时不比较浮点累加和，直接保留全部（受max_rank限制），避免舍入误差丢掉末尾的value
+    int keep = 0;
+    double kept = 0;
+    while (keep < n && keep < max_rank && (keep == 0 || mass >= 1 || kept / total < mass))
+    {
+        kept += seg.freq(keep);
+        keep += 1;
+    }
+
+    // ValueMap不支持删除，直接用保留下来的value重建映射（映射值为名次）
+    ValueMap kept_values;
+    kept_values.reserve(keep);
+    bool inserted;
+    for (int rank = 0; rank < keep; rank += 1)
+    {
+        kept_values.find_or_insert(seg.value(rank), seg.length, rank, inserted);
+    }
+    seg.values.swap(kept_values);
+    seg.flat_values.resize(size_t(keep) * seg.length);
+    seg.flat_values.shrink_to_fit();
+    if (!seg.packed_digits.empty())
+    {
+        seg.packed_digits.resize(keep);
+        seg.packed_digits.shrink_to_fit();
+    }
+    // freqs只在训练时使用，order()之后不再需要
+    vector<long long>().swap(seg.freqs);
+
+    if (quantize && seg.log_freqs.empty())
+    {
+        seg.log_freqs.resize(keep);
+        for (int rank = 0; rank < keep; rank += 1)
+        {
+            seg.log_freqs[rank] = (unsigned short)lround(log(double(seg.ordered_freqs[rank])) * LOG_FREQ_SCALE);
+        }
+        vector<long long>().swap(seg.ordered_freqs);
+    }
+    else if (seg.log_freqs.empty())
+    {
+        seg.ordered_freqs.resize(keep);
+        seg.ordered_freqs.shrink_to_fit();
+    }
+    else
+    {
+        seg.log_freqs.resize(keep);
+        seg.log_freqs.shrink_to_fit();
+    }
+
+    // 分母改为保留下来的频数之和，使概率重新归一。未量化时按整数累加，全部保留时total_freq不变
+    if (seg.log_freqs.empty())
+    {
+        seg.total_freq = 0;
+        for (int rank = 0; rank < keep; rank += 1)
+        {
+            seg.total_freq += seg.ordered_freqs[rank];
+        }
+    }
+    else
+    {
+        double sum = 0;
+        for (int rank = 0; rank < keep; rank += 1)
+        {
+            sum += seg.freq(rank);
+        }
+        seg.total_freq = llround(sum);
+    }
+    return keep == n ? 1.0 : kept / total;
+}
+
+double model::compact(double mass, int max_rank, int max_pts, bool quantize)
+{
+    cout << "Compacting model..." << endl;
+
+    // PT：ordered_pts已按概率降序排列。与segment相同，mass >= 1时保留全部（受max_pts限制）
+    int keep = 0;
+    double kept_pts = 0;
+    while (keep < ordered_pts.size() && keep < max_pts && (keep == 0 || mass >= 1 || kept_pts < mass))
+    {
+        kept_pts += ordered_pts[keep].preterm_prob;
+        keep += 1;
+    }
+
+    // 只保留仍被前keep个PT引用的segment。其余segment不会再用于生成猜测或打分，连同其频数一起删除，
+    // 并重新建立按长度的索引（segment在letters/digits/symbols中的下标因此改变）
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+        vector<long long> &segs_freq = type == 1 ? letters_freq : (type == 2 ? digits_freq : symbols_freq);
+        vector<int> &index = type == 1 ? letters_index : (type == 2 ? digits_index : symbols_index);
+        int &segs_id = type == 1 ? letters_id : (type == 2 ? digits_id : symbols_id);
+        vector<char> used(segs.size(), 0);
+        for (int i = 0; i < keep; i += 1)
+        {
+            for (const SegmentShape &seg : ordered_pts[i].content)
+            {
+                if (seg.type == type)
+                {
+                    used[index[seg.length]] = 1;
+                }
+            }
+        }
+        int count = 0;
+        for (int i = 0; i < segs.size(); i += 1)
+        {
+            if (!used[i])
+            {
+                continue;
+            }
+            if (count != i)
+            {
+                segs[count] = move(segs[i]);
+                if (i < segs_freq.size())
+                {
+                    segs_freq[count] = segs_freq[i];
+                }
+            }
+            count += 1;
+        }
+        segs.erase(segs.begin() + count, segs.end());
+        segs_freq.resize(min<size_t>(segs_freq.size(), count));
+        index.assign(index.size(), -1);
+        for (int i = 0; i < count; i += 1)
+        {
+            index[segs[i].length] = i;
+        }
+        segs_id = count - 1;
+    }
+
+    // 各segment保留的概率质量，用于计算整个模型舍弃的质量
+    vector<double> kept_mass[4];
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+        long long before = 0, after = 0;
+        double lost = 0, weight = 0;
+        for (SegmentStats &seg : segs)
+        {
+            before += seg.value_count();
+            double seg_weight = seg.total_freq;
+            double kept = CompactSegment(seg, mass, max_rank, quantize);
+            kept_mass[type].push_back(kept);
+            after += seg.value_count();
+            lost += (1 - kept) * seg_weight;
+            weight += seg_weight;
+        }
+        cout << "LDS"[type - 1] << " segments: " << segs.size() << " kept, values " << before << " -> " << after
+             << ", mass given up " << (weight > 0 ? lost / weight : 0) << endl;
+    }
+
+    // 按PT概率加权，计算整个模型舍弃的概率质量：舍弃的PT全部计入，保留的PT计入其segment舍弃的部分
+    double dropped_pts = 0;
+    for (int i = keep; i < ordered_pts.size(); i += 1)
+    {
+        dropped_pts += ordered_pts[i].preterm_prob;
+    }
+    double given_up = dropped_pts;
+    for (int i = 0; i < keep; i += 1)
+    {
+        double p = 1;
+        for (const SegmentShape &seg : ordered_pts[i].content)
+        {
+            vector<int> &index = seg.type == 1 ? letters_index : (seg.type == 2 ? digits_index : symbols_index);
+            p *= kept_mass[seg.type][index[seg.length]];
+        }
+        given_up += ordered_pts[i].preterm_prob * (1 - p);
+    }
+    cout << "PTs: " << ordered_pts.size() << " -> " << keep << ", mass given up " << dropped_pts << endl;
+    // 只有舍弃了PT时才重新归一，全部保留时PT概率保持不变
+    if (keep < ordered_pts.size())
+    {
+        ordered_pts.resize(keep);
+        for (PT &pt : ordered_pts)
+        {
+            pt.preterm_prob /= kept_pts;
+        }
+    }
+    pt_index.clear();
+    for (int i = 0; i < ordered_pts.size(); i += 1)
+    {
+        string key;
+        for (const SegmentShape &seg : ordered_pts[i].content)
+        {
+            AppendShapeKey(key, seg.type, seg.length);
+        }
+        pt_index[key] = i;
+    }
+    cout << "Total mass given up: " << given_up << endl;
+    return given_up;
+}
@@ -0,0 +1,345 @@
+#include "PCFG.h"
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+// 外存训练
+// 内存训练时每个不同的segment value都常驻在哈希表中，训练集的规模受内存限制。外存训练的流程是：
+// 1. 流式读入训练集并切分。PT和segment的种类数很少，直接在内存中统计；value以"类型+value"为键在内存中计数
+// 2. 计数表的估计内存超过预算时，将其排序后溢写为一个有序的run文件，然后清空
+// 3. 所有run多路归并（run过多时分多趟归并），相同的键在归并时相加，得到每个value的总频数
+// 4. 按segment收集(value, 频数)，按频数降序排序后直接建立有序的segment表
+// 于是训练过程中的内存由预算决定，而与训练集中不同value的数目无关（最终模型本身仍然包含全部value）
+
+// 一趟归并最多同时打开的run文件数
+#define MERGE_FAN_IN 64
+// 估计内存时，计数表中每个条目除键本身以外的开销（键偏移、条目编号、计数、按7/8负载折算的槽位和控制字节）
+#define SPILL_ENTRY_OVERHEAD 32
+
+// run文件中的一条记录：[键长度 u32][键][频数 u64]，键为一个字节的segment类型加上value，文件内按键升序排列
+struct RunReader
+{
+    ifstream in;
+    string key;
+    unsigned long long count = 0;
+    // 文件无法读取或最后一条记录不完整
+    bool failed = false;
+
+    bool next()
+    {
+        unsigned int len;
+        if (!in.read((char *)&len, sizeof(len)))
+        {
+            // 恰好在记录边界读到文件尾才是正常结束
+            failed = in.gcount() != 0 || !in.eof();
+            return false;
+        }
+        key.resize(len);
+        in.read(&key[0], len);
+        in.read((char *)&count, sizeof(count));
+        if (!in)
+        {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+static void WriteRecord(ofstream &out, const string &key, unsigned long long count)
+{
+    unsigned int len = key.size();
+    out.write((const char *)&len, sizeof(len));
+    out.write(key.data(), len);
+    out.write((const char *)&count, sizeof(count));
+}
+
+/// @brief 多路归并若干run文件，相同的键只输出一次，频数相加
+/// @param emit 按键升序对每个不同的键调用一次 emit(key, count)
+/// @return 所有run都完整读完时返回true，有run无法打开或读取出错时返回false
+template <typename Emit>
+static bool MergeRuns(const vector<string> &runs, Emit emit)
+{
+    vector<RunReader> readers(runs.size());
+    // 小根堆，堆顶是当前键最小的run
+    auto greater_key = [&](int a, int b)
+    { return readers[a].key > readers[b].key; };
+    priority_queue<int, vector<int>, decltype(greater_key)> heap(greater_key);
+    for (int i = 0; i < runs.size(); i += 1)
+    {
+        readers[i].in.open(runs[i], ios::binary);
+        if (!readers[i].in.is_open())
+        {
+            return false;
+        }
+        if (readers[i].next())
+        {
+            heap.push(i);
+        }
+    }
+    string key;
+    unsigned long long count = 0;
+    bool has_key = false;
+    while (!heap.empty())
+    {
+        int i = heap.top();
+        heap.pop();
+        if (has_key && readers[i].key == key)
+        {
+            count += readers[i].count;
+        }
+        else
+        {
+            if (has_key)
+            {
+                emit(key, count);
+            }
+            key = readers[i].key;
+            count = readers[i].count;
+            has_key = true;
+        }
+        if (readers[i].next())
+        {
+            heap.push(i);
+        }
+    }
+    if (has_key)
+    {
+        emit(key, count);
+    }
+    for (const RunReader &reader : readers)
+    {
+        if (reader.failed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool model::train_external(string path, size_t memory_budget, string tmp_dir)
+{
+    string run_prefix = tmp_dir + "/pcfg_run_" + to_string(random_device()()) + "_";
+    vector<string> runs;
+    // run文件编号单调递增，多趟归并时新的run不会覆盖尚未归并的run
+    int run_count = 0;
+    auto new_run = [&]()
+    {
+        runs.push_back(run_prefix + to_string(run_count++));
+        return runs.back();
+    };
+    // 训练集或run文件读写出错时放弃训练：删除所有run，并把模型清空，避免用残缺的统计数据生成猜测
+    auto fail = [&](const string &message)
+    {
+        cerr << "External training failed: " << message << endl;
+        for (const string &run : runs)
+        {
+            remove(run.c_str());
+        }
+        *this = model();
+        return false;
+    };
+
+    // value计数表及其估计内存。ValueMap的条目编号即buffer_counts的下标
+    ValueMap buffer;
+    vector<unsigned long long> buffer_counts;
+    size_t buffer_bytes = 0;
+    // 溢写成功（或计数表为空）时返回true
+    auto spill = [&]()
+    {
+        if (buffer.size() == 0)
+        {
+            return true;
+        }
+        // 按键的字节序排序，与string的比较结果一致
+        vector<int> entries(buffer.size());
+        for (int i = 0; i < entries.size(); i += 1)
+        {
+            entries[i] = i;
+        }
+        sort(entries.begin(), entries.end(), [&](int a, int b)
+             {
+                 int la = buffer.key_length(a), lb = buffer.key_length(b);
+                 int c = memcmp(buffer.key(a), buffer.key(b), min(la, lb));
+                 return c < 0 || (c == 0 && la < lb); });
+        ofstream out(new_run(), ios::binary);
+        for (int i : entries)
+        {
+            WriteRecord(out, string(buffer.key(i), buffer.key_length(i)), buffer_counts[i]);
+        }
+        out.close();
+        buffer.clear();
+        buffer_counts.clear();
+        buffer_bytes = 0;
+        return !out.fail();
+    };
+
+    // PT按结构键查找，segment按类型和长度查找，都在内存中
+    unordered_map<string, int> pt_ids;
+    vector<int> segment_ids[4];
+    vector<Token> tokens;
+    string key;
+    string value_key;
+    string pw;
+    ifstream train_set(path);
+    if (!train_set.is_open())
+    {
+        return fail("cannot open " + path);
+    }
+    long long lines = 0;
+    cout << "Training (external)..." << endl;
+    cout << "Training phase 1: reading, parsing and spilling passwords..." << endl;
+    while (train_set >> pw)
+    {
+        lines += 1;
+        if (lines % 1000000 == 0)
+        {
+            cout << "Lines processed: " << lines << ", runs: " << runs.size() << endl;
+        }
+        Tokenize(pw.data(), pw.length(), tokens);
+        if (!ShapesFit(tokens))
+        {
+            continue;
+        }
+        key.clear();
+        PT pt;
+        for (const Token &tok : tokens)
+        {
+            AppendShapeKey(key, tok.type, tok.length);
+            pt.insert(SegmentShape(tok.type, tok.length));
+
+            vector<int> &ids = segment_ids[tok.type];
+            if (tok.length >= ids.size())
+            {
+                ids.resize(tok.length + 1, -1);
+            }
+            vector<SegmentStats> &segs = tok.type == 1 ? letters : (tok.type == 2 ? digits : symbols);
+            vector<long long> &segs_freq = tok.type == 1 ? letters_freq : (tok.type == 2 ? digits_freq : symbols_freq);
+            if (ids[tok.length] == -1)
+            {
+                ids[tok.length] = tok.type == 1 ? GetNextLettersID() : (tok.type == 2 ? GetNextDigitsID() : GetNextSymbolsID());
+                segs.emplace_back(tok.type, tok.length);
+                segs_freq.emplace_back(0);
+            }
+            segs_freq[ids[tok.length]] += 1;
+
+            value_key.assign(1, char(tok.type));
+            value_key.append(pw, tok.start, tok.length);
+            bool inserted;
+            int entry = buffer.find_or_insert(value_key.data(), value_key.size(), buffer_counts.size(), inserted);
+            if (inserted)
+            {
+                buffer_bytes += value_key.size() + SPILL_ENTRY_OVERHEAD;
+                buffer_counts.emplace_back(1);
+            }
+            else
+            {
+                buffer_counts[entry] += 1;
+            }
+        }
+        total_preterm += 1;
+        auto found = pt_ids.find(key);
+        if (found == pt_ids.end())
+        {
+            pt.curr_indices.assign(pt.content.size(), 0);
+            pt_ids.emplace(key, GetNextPretermID());
+            preterminals.emplace_back(pt);
+            preterm_freq.emplace_back(1);
+        }
+        else
+        {
+            preterm_freq[found->second] += 1;
+        }
+        if (buffer_bytes > memory_budget && !spill())
+        {
+            return fail("cannot write run file " + runs.back());
+        }
+    }
+    if (train_set.bad())
+    {
+        return fail("error reading " + path);
+    }
+    if (!spill())
+    {
+        return fail("cannot write run file " + runs.back());
+    }
+    cout << "Lines processed: " << lines << ", runs: " << runs.size() << endl;
+
+    // run过多时，先分组归并成较大的run，直到可以一趟归并完
+    cout << "Training phase 2: merging runs..." << endl;
+    while (runs.size() > MERGE_FAN_IN)
+    {
+        vector<string> inputs;
+        inputs.swap(runs);
+        for (int first = 0; first < inputs.size(); first += MERGE_FAN_IN)
+        {
+            vector<string> group(inputs.begin() + first, inputs.begin() + min<size_t>(inputs.size(), first + MERGE_FAN_IN));
+            ofstream out(new_run(), ios::binary);
+            bool merged = MergeRuns(group, [&](const string &k, unsigned long long count)
+                                    { WriteRecord(out, k, count); });
+            out.close();
+            for (const string &run : group)
+            {
+                remove(run.c_str());
+            }
+            if (!merged || out.fail())
+            {
+                // 本趟中排在后面、尚未归并的输入run也交给fail删除
+                string failed = runs.back();
+                runs.insert(runs.end(), inputs.begin() + min<size_t>(inputs.size(), first + MERGE_FAN_IN), inputs.end());
+                return fail("cannot merge into run file " + failed);
+            }
+        }
+    }
+
+    // 最后一趟归并，按segment收集(value, 频数)
+    vector<vector<pair<long long, string>>> collected[4];
+    for (int type = 1; type <= 3; type += 1)
+    {
+        collected[type].resize(segment_ids[type].size());
+    }
+    bool merged = MergeRuns(runs, [&](const string &k, unsigned long long count)
+              {
+                  int type = k[0];
+                  int length = k.size() - 1;
+                  collected[type][length].emplace_back(count, k.substr(1)); });
+    if (!merged)
+    {
+        return fail("cannot read run files");
+    }
+    for (const string &run : runs)
+    {
+        remove(run.c_str());
+    }
+
+    // 直接建立有序的segment表：频数降序，频数相同时按value升序（归并输出本身按value升序，稳定排序保持这一顺序）
+    cout << "Training phase 3: building ordered segment tables..." << endl;
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+        for (int length = 0; length < segment_ids[type].size(); length += 1)
+        {
+            if (segment_ids[type][length] == -1)
+            {
+                continue;
+            }
+            vector<pair<long long, string>> &list = collected[type][length];
+            stable_sort(list.begin(), list.end(), [](const pair<long long, string> &a, const pair<long long, string> &b)
+                        { return a.first > b.first; });
+            vector<string> ordered_values;
+            vector<long long> counts;
+            for (pair<long long, string> &item : list)
+            {
+                counts.emplace_back(item.first);
+                ordered_values.emplace_back(move(item.second));
+            }
+            list.clear();
+            list.shrink_to_fit();
+            segs[segment_ids[type][length]].fill_ordered(ordered_values, counts);
+        }
+    }
+    return true;
+}
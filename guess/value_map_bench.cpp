@@ -0,0 +1,154 @@
+#include "PCFG.h"
+#include <chrono>
+#include <fstream>
+using namespace std;
+using namespace chrono;
+
+// 编译指令如下
+// g++ value_map_bench.cpp train.cpp -o value_map_bench -O2 -fopenmp
+//
+// 运行方式：./value_map_bench [训练集] [最多读入的行数]
+// 比较训练时两种计数方式的用时：原来的unordered_map<string, int>（先find再emplace），以及ValueMap（一次查找或插入）
+// 1. 口令去重计数（对应PasswordCounts）
+// 2. segment value计数（对应SegmentStats::insert），每个(类型, 长度)一个表
+// 两种方式的计数结果会逐项核对
+
+static double Seconds(system_clock::time_point start)
+{
+    return duration_cast<microseconds>(system_clock::now() - start).count() / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    string path = argc > 1 ? argv[1] : "/guessdata/Rockyou-singleLined-full.txt";
+    long long max_lines = argc > 2 ? atoll(argv[2]) : 3000000;
+    vector<string> pws;
+    ifstream file(path);
+    string pw;
+    while (pws.size() < max_lines && file >> pw)
+    {
+        pws.push_back(pw);
+    }
+    if (pws.empty())
+    {
+        cout << "无法读取训练集: " << path << endl;
+        return 1;
+    }
+    cout << "口令数: " << pws.size() << endl;
+
+    // 口令计数
+    auto start = system_clock::now();
+    unordered_map<string, int> pw_map;
+    for (const string &p : pws)
+    {
+        auto it = pw_map.find(p);
+        if (it == pw_map.end())
+        {
+            pw_map.emplace(p, 1);
+        }
+        else
+        {
+            it->second += 1;
+        }
+    }
+    double pw_map_time = Seconds(start);
+
+    start = system_clock::now();
+    ValueMap pw_table;
+    for (const string &p : pws)
+    {
+        bool inserted;
+        pw_table.find_or_insert(p.data(), p.length(), 0, inserted) += 1;
+    }
+    double pw_table_time = Seconds(start);
+
+    bool ok = pw_map.size() == pw_table.size();
+    for (int i = 0; ok && i < pw_table.size(); i += 1)
+    {
+        ok = pw_map.at(string(pw_table.key(i), pw_table.key_length(i))) == pw_table.value(i);
+    }
+    cout << "口令计数: 不同口令 " << pw_table.size() << endl;
+    cout << "  unordered_map: " << pw_map_time << "s, ValueMap: " << pw_table_time << "s, 加速比 " << pw_map_time / pw_table_time
+         << (ok ? "" : "  计数不一致!") << endl;
+
+    // segment value计数。切分不计入时间
+    vector<vector<Token>> all_tokens(pws.size());
+    for (size_t i = 0; i < pws.size(); i += 1)
+    {
+        Tokenize(pws[i].data(), pws[i].length(), all_tokens[i]);
+    }
+    auto table_id = [](const Token &tok)
+    {
+        return tok.length * 4 + tok.type;
+    };
+    int tables = 0;
+    for (const vector<Token> &tokens : all_tokens)
+    {
+        for (const Token &tok : tokens)
+        {
+            tables = max(tables, table_id(tok) + 1);
+        }
+    }
+
+    // 原来的SegmentStats::insert：value先构造为string，find一次，不存在时再emplace一次
+    start = system_clock::now();
+    vector<unordered_map<string, int>> seg_maps(tables);
+    vector<vector<int>> map_freqs(tables);
+    for (size_t i = 0; i < pws.size(); i += 1)
+    {
+        for (const Token &tok : all_tokens[i])
+        {
+            int t = table_id(tok);
+            string value = pws[i].substr(tok.start, tok.length);
+            auto it = seg_maps[t].find(value);
+            if (it == seg_maps[t].end())
+            {
+                seg_maps[t].emplace(value, map_freqs[t].size());
+                map_freqs[t].emplace_back(1);
+            }
+            else
+            {
+                map_freqs[t][it->second] += 1;
+            }
+        }
+    }
+    double seg_map_time = Seconds(start);
+
+    start = system_clock::now();
+    vector<ValueMap> seg_tables(tables);
+    vector<vector<int>> table_freqs(tables);
+    for (size_t i = 0; i < pws.size(); i += 1)
+    {
+        for (const Token &tok : all_tokens[i])
+        {
+            int t = table_id(tok);
+            bool inserted;
+            int id = seg_tables[t].find_or_insert(pws[i].data() + tok.start, tok.length, table_freqs[t].size(), inserted);
+            if (inserted)
+            {
+                table_freqs[t].emplace_back(1);
+            }
+            else
+            {
+                table_freqs[t][id] += 1;
+            }
+        }
+    }
+    double seg_table_time = Seconds(start);
+
+    ok = true;
+    size_t values = 0;
+    for (int t = 0; ok && t < tables; t += 1)
+    {
+        values += seg_tables[t].size();
+        ok = seg_maps[t].size() == seg_tables[t].size() && map_freqs[t] == table_freqs[t];
+        for (int id = 0; ok && id < seg_tables[t].size(); id += 1)
+        {
+            ok = seg_maps[t].at(string(seg_tables[t].key(id), seg_tables[t].key_length(id))) == id;
+        }
+    }
+    cout << "segment value计数: 不同value " << values << endl;
+    cout << "  unordered_map: " << seg_map_time << "s, ValueMap: " << seg_table_time << "s, 加速比 " << seg_map_time / seg_table_time
+         << (ok ? "" : "  计数不一致!") << endl;
+    return ok ? 0 : 1;
+}
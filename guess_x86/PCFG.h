@@ -2,17 +2,92 @@
 #include <iostream>
 #include <unordered_map>
 #include <queue>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
 #include <omp.h>
+#include "value_map.h"
 // #include <chrono>   
 // using namespace chrono;
 using namespace std;
 
-class segment
+// 口令中一段连续的同类字符，由Tokenize切分得到
+struct Token
+{
+    int type;   // 1: 字母, 2: 数字, 3: 特殊字符
+    int start;  // 在口令中的起始位置
+    int length; // 长度
+};
+
+// 按字符类别把口令切分为若干Token，结果覆盖写入tokens
+// 训练时的parse和打分时的Score共用这一切分，保证两者对同一口令得到相同的PT
+void Tokenize(const char *pw, int len, vector<Token> &tokens);
+
+// 将一个segment的类型和长度追加到PT的查找键中，用于按PT结构做哈希查找
+inline void AppendShapeKey(string &key, int type, int length)
+{
+    key.push_back(char(type));
+    key.push_back(char(length & 0xff));
+    key.push_back(char(length >> 8));
+}
+
+// 把BCD压缩的数字（最多8位，第一个数字在最低的4位）还原为ASCII，一次写出8个字节（不足8位时多余的字节无意义）
+inline void UnpackDigits(unsigned long long bcd, char *out)
+{
+    // 把每4位展开到一个字节：32位 -> 2x16位 -> 4x8位... -> 8x4位，然后加上'0'
+    unsigned long long x = bcd & 0xffffffffULL;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x += 0x3030303030303030ULL;
+    memcpy(out, &x, 8);
+}
+
+// 按需排序时第一次排好的value数目
+#define SEGMENT_ORDER_INITIAL 1024
+
+// 频数量化为16位对数时的刻度：log_freq = round(ln(freq) * LOG_FREQ_SCALE)
+// 频数为long long，ln(2^63) * 1024 < 65536，相邻两档之间的相对误差约为0.1%
+#define LOG_FREQ_SCALE 1024
+
+// SegmentShape的长度只占一个字节，含有更长segment的口令不参与训练
+#define MAX_SEGMENT_LENGTH 255
+
+// segment的描述：只有类型和长度，PT的content和切分都使用它
+// 只占2个字节且可以直接按字节拷贝，拷贝PT时不涉及任何内存分配
+struct SegmentShape
+{
+    unsigned char type;   // 0: 未设置, 1: 字母, 2: 数字, 3: 特殊字符
+    unsigned char length; // 长度，例如S6的长度就是6
+    SegmentShape() = default;
+    SegmentShape(int type, int length) : type(type), length(length) {}
+
+    // 打印相关信息
+    void PrintSeg() const;
+};
+static_assert(sizeof(SegmentShape) == 2 && is_trivially_copyable<SegmentShape>::value, "SegmentShape must stay a 2-byte POD");
+
+// 切分结果中的每个segment是否都能用SegmentShape表示
+inline bool ShapesFit(const vector<Token> &tokens)
+{
+    for (const Token &tok : tokens)
+    {
+        if (tok.length > MAX_SEGMENT_LENGTH)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 一个segment（类型和长度）在模型中的统计数据，由model持有，每种segment只有一份
+class SegmentStats
 {
 public:
     int type; // 0: 未设置, 1: 字母, 2: 数字, 3: 特殊字符
     int length; // 长度，例如S6的长度就是6
-    segment(int type, int length)
+    SegmentStats(int type, int length)
     {
         this->type = type;
         this->length = length;
@@ -21,24 +96,85 @@ public:
     // 打印相关信息
     void PrintSeg();
 
-    // 按照概率降序排列的value。例如，123是D3的一个具体value，其概率在D3的所有value中排名第三，那么其位置就是ordered_values[2]
-    vector<string> ordered_values;
+    // 按照概率降序排列的value。同一个segment的value长度都是length，因此连续定长存放：第i个value位于
+    // flat_values[i*length, (i+1)*length)。例如，123是D3的一个具体value，其概率在D3的所有value中排名第三，
+    // 那么它就是value(2)，即flat_values[6..8]
+    vector<char> flat_values;
+
+    // 数字segment（长度不超过16）的value的BCD压缩形式，每个数字占4位，第一个数字在最低的4位
+    // 每个value只占8个字节，可以用UnpackDigits一次还原为ASCII
+    vector<unsigned long long> packed_digits;
+
+    // 第i个value的首地址，共length个字节
+    const char *value(int i) const
+    {
+        return flat_values.data() + size_t(i) * length;
+    }
+
+    // 已经排好序的value数目。value(i)、freq(i)和packed_digits[i]只对i < ordered_count()有效
+    int ordered_count() const
+    {
+        return flat_values.size() / length;
+    }
+
+    // value的总数
+    int value_count() const
+    {
+        return values.size();
+    }
 
     // 按照概率降序排列的频数（概率）
-    vector<int> ordered_freqs;
+    vector<long long> ordered_freqs;
+
+    // 量化后的频数，第i个value的频数为exp(log_freqs[i] / LOG_FREQ_SCALE)
+    // 由model::compact()生成，生成后ordered_freqs被清空
+    vector<unsigned short> log_freqs;
+
+    // 第i个value的频数，读取频数时统一使用这个函数
+    double freq(int i) const
+    {
+        return log_freqs.empty() ? ordered_freqs[i] : exp(log_freqs[i] * (1.0 / LOG_FREQ_SCALE));
+    }
 
     // total_freq作为分母，用于计算每个value的概率
-    int total_freq = 0;
+    // 压缩之后为保留下来的value的频数之和，因此概率仍然归一
+    long long total_freq = 0;
+
+    // value到id的映射。训练时id按出现顺序分配，与ValueMap的条目编号相同；全部value排好序之后id被改写为value的名次，
+    // 因此打分时values中的映射值可以直接作为ordered_freqs的下标
+    ValueMap values;
 
-    // 未排序的value，其中int就是对应的id
-    unordered_map<string, int> values;
+    // 根据id，在freqs中查找/修改一个value的频数。id是连续分配的，因此直接用数组下标
+    vector<long long> freqs;
 
-    // 根据id，在freqs中查找/修改一个value的频数
-    unordered_map<int, int> freqs;
+    // 按values中的映射值取频数：全部value排好序之前映射值是训练时的id，之后是名次
+    double key_freq(int key) const
+    {
+        return ordered_count() < value_count() ? freqs[key] : freq(key);
+    }
 
+    // 按需排序时所有value的id：前ordered_count()个已按名次排好，其余尚未排序。全部排好后释放
+    // id就是values中的条目编号，因此第id个value可以直接用values.key(id)取得
+    vector<int> pending;
 
-    void insert(string value);
+    // 插入一个value（长度为length），count为其出现次数
+    void insert(const char *value, long long count = 1);
+
+    // 计算total_freq。value的排序推迟到ensure_ordered()中按需进行
     void order();
+
+    // 保证前n个value已经排好序。未排序部分用nth_element选出下一段再排序，排好的前缀每次至少翻倍
+    // 排序规则为频数降序，频数相同时按id（首次出现的顺序）升序，因此结果与一次性全部排序完全相同
+    void ensure_ordered(int n);
+
+    // 排好全部value
+    void finish_order()
+    {
+        ensure_ordered(value_count());
+    }
+
+    // 由已经按频数降序排好的value及其频数直接建立有序的表（flat_values、ordered_freqs等）
+    void fill_ordered(const vector<string> &ordered_values, const vector<long long> &counts);
     void PrintValues();
 };
 
@@ -46,17 +182,18 @@ class PT
 {
 public:
     // 例如，L6D1的content大小为2，content[0]为L6，content[1]为D1
-    vector<segment> content;
+    vector<SegmentShape> content;
 
     // pivot值，参见PCFG的原理
     int pivot = 0;
-    void insert(segment seg);
+    void insert(SegmentShape seg);
     void PrintPT();
 
     // 导出新的PT
     vector<PT> NewPTs();
 
     // 记录当前每个segment（除了最后一个）对应的value，在模型中的下标
+    // 最后一个segment对应的是下一次出队时开始输出的value的下标
     vector<int> curr_indices;
 
     // 记录当前每个segment（除了最后一个）对应的value，在模型中的最大下标（即最大可以是max_indices[x]-1）
@@ -66,6 +203,15 @@ public:
     float prob;
 };
 
+// 一条口令的打分结果
+struct PasswordScore
+{
+    int pt = -1;              // PT在ordered_pts中的下标，-1表示模型中没有这个PT
+    float preterm_prob = 0;   // PT本身的概率
+    double value_prob = 0;    // 各segment取到对应value的概率之积
+    double prob = 0;          // 口令的概率，即preterm_prob * value_prob
+};
+
 class model
 {
 public:
@@ -99,55 +245,233 @@ public:
     // C++上机和数据结构实验中，一般不允许使用stl
     // 这就导致大家对stl不甚熟悉。现在是时候体会stl的便捷之处了
     // unordered_map: 无序映射
-    int total_preterm = 0;
+    long long total_preterm = 0;
     vector<PT> preterminals;
     int FindPT(PT pt);
 
-    vector<segment> letters;
-    vector<segment> digits;
-    vector<segment> symbols;
-    int FindLetter(segment seg);
-    int FindDigit(segment seg);
-    int FindSymbol(segment seg);
+    vector<SegmentStats> letters;
+    vector<SegmentStats> digits;
+    vector<SegmentStats> symbols;
+    int FindLetter(SegmentShape seg);
+    int FindDigit(SegmentShape seg);
+    int FindSymbol(SegmentShape seg);
 
-    unordered_map<int, int> preterm_freq;
-    unordered_map<int, int> letters_freq;
-    unordered_map<int, int> digits_freq;
-    unordered_map<int, int> symbols_freq;
+    // 以下频数都以GetNext*ID分配的连续id为下标
+    vector<long long> preterm_freq;
+    vector<long long> letters_freq;
+    vector<long long> digits_freq;
+    vector<long long> symbols_freq;
 
     vector<PT> ordered_pts;
 
+    // 以下查找表在order()中建立，供打分使用
+    // 按长度直接索引segment在letters/digits/symbols中的下标，-1表示不存在
+    vector<int> letters_index;
+    vector<int> digits_index;
+    vector<int> symbols_index;
+    // PT结构（见AppendShapeKey）到其在ordered_pts中下标的映射
+    unordered_map<string, int> pt_index;
+
+    // 按类型和长度找到模型中的segment，不存在时返回nullptr
+    const SegmentStats *GetSegment(int type, int length) const;
+    SegmentStats *GetSegment(int type, int length)
+    {
+        return const_cast<SegmentStats *>(static_cast<const model &>(*this).GetSegment(type, length));
+    }
+
     // 给定一个训练集，对模型进行训练
     void train(string train_path);
 
+    // 给定一个已经去重计数的训练集（每行为"出现次数\t口令"），对模型进行训练
+    void train_counted(string train_path);
+
+    // 外存训练：用于比内存大得多的训练集，不限制行数
+    // segment的value记录在内存中计数，超过memory_budget字节时排序后溢写到tmp_dir下的有序run文件，
+    // 最后多路归并得到每个value的总频数，并直接建立有序的segment表。之后仍需调用order()对PT排序
+    // 训练集或run文件读写失败时输出错误、清空模型并返回false
+    bool train_external(string train_path, size_t memory_budget = size_t(1) << 30, string tmp_dir = ".");
+
+    // 近似训练：每个segment最多保留value_capacity个value，PT最多保留pt_capacity个（Space-Saving算法）
+    // 模型大小和order()的时间都是固定的，高频value的频数有误差保证：保留的频数c与真实频数f满足 c-error <= f <= c，
+    // 且 error <= N/capacity（N为该segment出现的总次数）。训练结束时打印每个segment的误差界
+    void train_heavy_hitters(string train_path, int value_capacity = 100000, int pt_capacity = 10000);
+
     // 对已经训练的模型进行保存
     void store(string store_path);
 
     // 从现有的模型文件中加载模型
     void load(string load_path);
 
-    // 对一个给定的口令进行切分
-    void parse(string pw);
+    // 对一个给定的口令进行切分，count为该口令在训练集中的出现次数
+    void parse(string pw, long long count = 1);
 
+    // 对PT排序并建立查找表。segment的value在生成猜测时按需排序，见SegmentStats::ensure_ordered
     void order();
 
+    // 保证所有segment的前n个value已经排好序，各segment并行排序
+    void ensure_ordered(int n);
+
+    // 排好所有segment的全部value。按名次遍历全部value的场合（概率分带枚举、模型压缩等）需要先调用
+    void finish_order();
+
+    // 计算单条口令在模型下的概率，模型无法生成该口令时返回false（概率记为0）
+    bool Score(const char *pw, int len, PasswordScore &score) const;
+
+    // 多线程批量打分，scores[i]对应pws[i]
+    void ScoreBatch(const string *pws, size_t count, PasswordScore *scores) const;
+
+    // 对文件中的每一行口令打分（文件以mmap方式读入），scores[i]对应第i行
+    bool ScoreFile(const string &path, vector<PasswordScore> &scores) const;
+
+    // 模型压缩，需在order()之后调用
+    // 每个segment按频数降序保留value，直到保留的概率质量达到mass或数目达到max_rank；PT同理，由mass和max_pts决定
+    // quantize为true时把频数量化为16位对数（见LOG_FREQ_SCALE）。保留部分的概率重新归一
+    // 只被舍弃的PT引用的segment一并删除，letters/digits/symbols中的下标随之改变，按长度的索引会重新建立
+    // mass >= 1且不限制数目、不量化时压缩是无损的：所有value和PT的频数、概率保持不变
+    // 打印每类segment和PT舍弃的概率质量，返回整个模型舍弃的概率质量（按PT概率加权）
+    double compact(double mass = 1.0, int max_rank = 1 << 30, int max_pts = 1 << 30, bool quantize = true);
+
     // 打印模型
     void print();
 };
 
+// 蒙特卡洛猜测数估计（Dell'Amico & Filippone, CCS 2015）
+// 从模型中按概率抽样n条口令，概率为p_i。对任意概率p，概率大于p的口令数（即按概率降序枚举时p之前的猜测数）
+// 的无偏估计为 sum_{p_i > p} 1/(n*p_i)。样本按概率降序排好并预先求出前缀和后，每次查询只需一次二分查找
+class GuessNumberEstimator
+{
+public:
+    // 从模型（需已order）中抽样sample_count条口令并建立累计表，相同的seed得到相同的结果
+    void build(const model &m, size_t sample_count, unsigned long long seed = 0);
+
+    // 估计概率大于prob的口令数。low/high非空时写入95%置信区间
+    // prob为0（模型无法生成）时返回INFINITY
+    double estimate(double prob, double *low = nullptr, double *high = nullptr) const;
+
+    // 先对口令打分，再估计其猜测数
+    double estimate(const model &m, const string &pw, double *low = nullptr, double *high = nullptr) const;
+
+    // 样本概率，降序
+    vector<double> probs;
+    // ranks[i] = sum_{j<i} 1/(n*probs[j])，即概率大于probs[i]的口令数的估计，共n+1项
+    vector<double> ranks;
+    // sum_{j<i} 1/(n*probs[j]^2)，用于估计方差
+    vector<double> ranks_sq;
+};
+
+// 测试集评估：在生成猜测的同时统计命中了测试集中的多少口令，得到"猜测数-命中率"曲线
+// 测试集中重复出现的口令按出现次数计数，命中时一次计入全部次数
+class TestSetEvaluator
+{
+public:
+    // 载入测试集，每行一条口令
+    bool load(const string &path);
+
+    // 按生成顺序检查一批新的猜测，并在经过的记录点上记录累计命中数
+    void check(const vector<string> &batch);
+
+    // 写出命中曲线，每行为"猜测数\t累计命中数\t命中率"，最后一行为当前的猜测数
+    bool write_curve(const string &path) const;
+
+    size_t total = 0;   // 测试集口令总数（计重复）
+    size_t hits = 0;    // 累计命中数（计重复）
+    size_t guesses = 0; // 已检查的猜测数
+
+    // 记录点上的(猜测数, 累计命中数)。记录点按对数间隔分布，每个数量级10个
+    vector<pair<size_t, size_t>> curve;
+
+private:
+    unordered_map<string, int> index; // 口令到测试集条目下标的映射
+    vector<int> multiplicity;         // 每个条目在测试集中出现的次数
+    vector<char> cracked;             // 条目是否已被命中，保证每个条目只计一次
+    int next_point = 0;               // 下一个记录点的序号
+    size_t next_checkpoint = 1;       // 下一个记录点的猜测数
+    void advance_checkpoint();
+};
+
+// 口令策略（长度限制、必须包含的字符类别等）
+// PT的结构就决定了它生成的所有口令的长度和字符类别，因此策略可以在PT这一级判定：
+// 不满足策略的PT根本不会入队，也就不会生成任何猜测
+struct PasswordPolicy
+{
+    int min_length = 0;
+    int max_length = 1 << 30;
+    bool require_letter = false;
+    bool require_digit = false;
+    bool require_symbol = false;
+    // 至少包含几类字符（字母、数字、特殊字符中的几类）
+    int min_classes = 0;
+
+    // 判断一个PT生成的口令是否满足策略
+    bool Allows(const PT &pt) const;
+};
+
+// 概率分带枚举：不维护全局优先队列，而是把猜测空间按概率切成若干带 [p_k, p_{k-1})
+// 每个带内对每个PT独立地沿各segment的有序value表递归下降，用带的上下界剪枝
+// 不同的带、同一个带内不同的PT之间没有任何依赖，可以分给不同的线程乃至不同的机器
+// 按k递增依次拼接各带的输出，就得到粗粒度的概率降序猜测流（带内不保证顺序）
+class BandEnumerator
+{
+public:
+    // m需已order（构造时会排好全部value），且在枚举期间保持不变
+    // 第k个带为[top*ratio^(k+1), top*ratio^k)，其中k=0的上界视为无穷大
+    BandEnumerator(model &m, double top = 1e-2, double ratio = 0.5);
+
+    // 第k个带的下界和上界
+    double lower(int k) const;
+    double upper(int k) const;
+
+    // 覆盖全部猜测所需的带数：最后一个带的下界不高于模型中概率最低的口令
+    int count() const;
+
+    // 生成第k个带的全部猜测，追加到guesses。各PT并行枚举，输出按PT顺序拼接
+    void enumerate(int k, vector<string> &guesses) const;
+
+    // 生成第pt个PT（ordered_pts中的下标）中概率在[low, high)内的全部猜测
+    void enumerate(int pt, double low, double high, vector<string> &guesses) const;
+
+    // 枚举时猜测的概率与model::Score的计算方式完全一致，因此每条猜测恰好落在一个带中
+    const model &m;
+    double top;
+    double ratio;
+
+    // 口令策略，不满足策略的PT不生成任何猜测，默认不做任何限制
+    PasswordPolicy policy;
+
+private:
+    // 每个PT的各segment在模型中的统计数据
+    vector<vector<const SegmentStats *>> pt_segments;
+    // rest_max[pt][i]: 第i个及之后的segment都取最高频value时的概率之积，用于剪枝
+    vector<vector<double>> rest_max;
+    // 模型中概率最低的口令的概率，即各PT的每个segment都取最低频value时的概率的最小值
+    double min_prob = INFINITY;
+
+    void descend(int pt, int depth, double value_prob, double low, double high, string &prefix, vector<string> &guesses) const;
+};
+
+// PT出队时，最后一个segment一次最多输出的value数。剩余的value连同PT一起重新入队，
+// 概率按下一个待输出的value计算，这样一个很大的segment（例如L8）不会一次输出大量低概率猜测
+#define LAST_SEGMENT_CHUNK 4096
+
 // 优先队列，用于按照概率降序生成口令猜测
 // 实际上，这个class负责队列维护、口令生成、结果存储的全部过程
 class PriorityQueue
 {
 public:
-    // 用vector实现的priority queue
+    // 用vector实现的priority queue，按PT的概率维护成大根堆，front()是概率最高的PT
     vector<PT> priority;
 
     // 模型作为成员，辅助猜测生成
     model m;
 
-    // 计算一个pt的概率
-    void CalProb(PT &pt);
+    // 口令策略，默认不做任何限制。需要在init()之前设置
+    PasswordPolicy policy;
+
+    // 计算一个pt的概率。只读模型，pt的各segment当前的value需已排好序
+    void CalProb(PT &pt) const;
+
+    // 按需排序：保证pt的各segment排好了当前的value。会修改模型，只能串行调用
+    void OrderIndices(const PT &pt);
 
     // 优先队列的初始化
     void init();
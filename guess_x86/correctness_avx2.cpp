@@ -1,11 +1,15 @@
 #include <chrono>
 #include <iomanip>
+#include <fstream>
 #include "md5.h"
 #include "md5_avx2.h"
 
 using namespace std;
 using namespace chrono;
 
+// 编译指令如下（所有文件都不使用-mavx2，md5_avx2.cpp内部以target("avx2")编译AVX2的内核）
+// g++ -O2 -fopenmp correctness_avx2.cpp md5.cpp md5_batch.cpp md5_avx2.cpp -o correctness_avx2
+
 // 打印MD5哈希值
 void printHash(const bit32* state) {
     for(int i = 0; i < 4; i++) {
@@ -103,17 +107,8 @@ int main() {
     bit32* results = new bit32[testCount * 4];
     
     auto start_avx = high_resolution_clock::now();
-    for(int i = 0; i < testCount; i += 8) {
-        int batchSize = min(8, testCount - i);
-        // 如果不是8的倍数，需要补齐到8个
-        if (batchSize < 8) {
-            for (int j = batchSize; j < 8; j++) {
-                inputs[i + j] = inputs[i]; // 用重复数据填充
-            }
-            batchSize = 8;
-        }
-        MD5Hash_AVX2(inputs + i, batchSize, results + i*4);
-    }
+    // 尾部不足8个的部分由MD5Hash_AVX2内部处理，不再改写inputs
+    MD5Hash_AVX2(inputs, testCount, results);
     auto end_avx = high_resolution_clock::now();
     auto duration_avx = duration_cast<microseconds>(end_avx - start_avx).count();
     
@@ -121,6 +116,152 @@ int main() {
     cout << "串行版本耗时: " << duration_serial << " 微秒" << endl;
     cout << "AVX2版本耗时: " << duration_avx << " 微秒" << endl;
     cout << "加速比: " << double(duration_serial) / duration_avx << "x" << endl;
+
+    // 统一批量接口：长度0~130覆盖了每一种填充情况（包括长度模64为56~63的消息）
+    const int batchCount = 131;
+    string* batchInputs = new string[batchCount];
+    bit32 (*batchSerial)[4] = new bit32[batchCount][4];
+    for(int i = 0; i < batchCount; i++) {
+        batchInputs[i] = string(i, 'a' + i % 26);
+        MD5Hash(batchInputs[i], batchSerial[i]);
+    }
+    // 60个'a'的标准MD5，用于确认串行版本本身的填充是正确的
+    const bit32 expect60[4] = {0xcc7ed669, 0xcf88f201, 0xc3297c6a, 0x91e1d18d};
+    bit32 state60[4];
+    MD5Hash(string(60, 'a'), state60);
+    if(!compareHash(state60, expect60)) {
+        cout << "串行版本60字节消息的结果错误!" << endl;
+        allCorrect = false;
+    }
+    bit32* batchResults = nullptr;
+    posix_memalign((void**)&batchResults, 32, batchCount * 4 * sizeof(bit32));
+    MD5Impl impls[] = {MD5_IMPL_SCALAR, MD5_IMPL_SSE2, MD5_IMPL_AVX2, MD5_IMPL_SSE2_SCALAR1,
+                       MD5_IMPL_SSE2_SCALAR2, MD5_IMPL_AVX2_SCALAR1, MD5_IMPL_AVX2_SCALAR2};
+    for(MD5Impl impl : impls) {
+        md5_batch(batchInputs, batchCount, batchResults, impl);
+        int mismatches = 0;
+        for(int i = 0; i < batchCount; i++) {
+            if(!compareHash(batchSerial[i], batchResults + i * 4)) mismatches++;
+        }
+        cout << "md5_batch(" << md5_impl_name(impl) << "): " << (mismatches == 0 ? "全部匹配" : "存在不匹配!") << endl;
+        allCorrect = allCorrect && mismatches == 0;
+    }
+    cout << "当前CPU选择的实现: " << md5_impl_name(md5_select_impl()) << endl;
+    
+    // 足够大的批次会被分给多个线程，检查各线程写入的摘要区间互不干扰
+    const int largeCount = 50000;
+    string* largeInputs = new string[largeCount];
+    for(int i = 0; i < largeCount; i++) {
+        largeInputs[i] = string(i % 97, 'x') + to_string(i);
+    }
+    bit32* largeResults = new bit32[largeCount * 4];
+    md5_batch(largeInputs, largeCount, largeResults);
+    int largeMismatches = 0;
+    for(int i = 0; i < largeCount; i++) {
+        bit32 state[4];
+        MD5Hash(largeInputs[i], state);
+        if(!compareHash(state, largeResults + i * 4)) largeMismatches++;
+    }
+    cout << "多线程md5_batch(" << dec << largeCount << "条): " << (largeMismatches == 0 ? "全部匹配" : "存在不匹配!") << endl;
+    allCorrect = allCorrect && largeMismatches == 0;
+    
+    // 破解模式：少量目标（广播比较）和大量目标（逐通道查找）两种情况下，都只能报告真正命中的输入
+    const int hitIndex[3] = {7, 12345, largeCount - 1};
+    for(int targetCount : {3, 200}) {
+        vector<bit32> targetDigests;
+        for(int i = 0; i < targetCount; i++) {
+            const bit32* d = i < 3 ? largeResults + hitIndex[i] * 4 : largeResults + (i * 131) % largeCount * 4;
+            bit32 digest[4] = {d[0], d[1], d[2], d[3] ^ (i < 3 ? 0u : 1u)}; // 其余目标与真实摘要只差最后一位
+            targetDigests.insert(targetDigests.end(), digest, digest + 4);
+        }
+        MD5TargetSet targets;
+        md5_build_targets(targetDigests.data(), targetCount, targets);
+        for(MD5Impl impl : impls) {
+            vector<MD5Hit> hits;
+            md5_crack_batch(largeInputs, largeCount, targets, hits, impl);
+            bool ok = hits.size() == 3;
+            for(size_t i = 0; ok && i < hits.size(); i++) {
+                ok = hits[i].index == (size_t)hitIndex[i] && compareHash(hits[i].digest, largeResults + hitIndex[i] * 4);
+            }
+            cout << "md5_crack_batch(" << md5_impl_name(impl) << ", " << targetCount << "个目标): " << (ok ? "正确" : "错误!") << endl;
+            allCorrect = allCorrect && ok;
+        }
+    }
+    
+    // 从十六进制文件载入目标：大小写混合、夹杂无法解析的行，大量非命中目标走过滤器
+    {
+        const char* path = "correctness_targets.txt";
+        ofstream out(path);
+        out << "not a hash" << endl;
+        for(int i = 0; i < 5000; i++) {
+            const bit32* d = largeResults + (i < 3 ? hitIndex[i] : i) * 4;
+            out << (i == 1 ? uppercase : nouppercase) << hex << setfill('0');
+            for(int j = 0; j < 4; j++) {
+                out << setw(8) << (j == 3 && i >= 3 ? d[j] ^ 1u : d[j]);
+            }
+            out << dec << endl;
+        }
+        out.close();
+        MD5TargetSet targets;
+        bool loaded = md5_load_targets(path, targets);
+        remove(path);
+        for(MD5Impl impl : impls) {
+            vector<MD5Hit> hits;
+            md5_crack_batch(largeInputs, largeCount, targets, hits, impl);
+            bool ok = loaded && targets.digests.size() == 5000 * 4 && hits.size() == 3;
+            for(size_t i = 0; ok && i < hits.size(); i++) {
+                ok = hits[i].index == (size_t)hitIndex[i];
+            }
+            cout << "md5_load_targets + 过滤器(" << md5_impl_name(impl) << "): " << (ok ? "正确" : "错误!") << endl;
+            allCorrect = allCorrect && ok;
+        }
+    }
+    
+    // 单目标模式：逆推的快速路径必须与串行MD5Hash逐条比较的结果完全一致
+    // 输入包括各种长度的短口令（被逆推的消息字为0或不为0）、重复的口令以及多块的长口令
+    {
+        vector<string> singleInputs;
+        for(int i = 0; i < 20000; i++) {
+            singleInputs.push_back(to_string(i * 7919 % 100000));
+        }
+        for(int len = 0; len < 130; len++) {
+            singleInputs.push_back(string(len, 'a' + len % 26));
+        }
+        singleInputs.push_back("4242");
+        // 同一长度、只有开头不同：被逆推的消息字不为0但各通道相同，逆推的状态按批现算
+        for(int i = 0; i < 2000; i++) {
+            singleInputs.push_back(to_string(1000 + i) + "suffix-suffix-su");
+        }
+        int mismatches = 0;
+        for(size_t t = 0; t < singleInputs.size(); t += 997) {
+            bit32 digest[4];
+            MD5Hash(singleInputs[t], digest);
+            MD5SingleTarget target;
+            md5_prepare_single_target(digest, target);
+            vector<size_t> expect;
+            for(size_t i = 0; i < singleInputs.size(); i++) {
+                bit32 state[4];
+                MD5Hash(singleInputs[i], state);
+                if(compareHash(state, digest)) expect.push_back(i);
+            }
+            for(MD5Impl impl : impls) {
+                vector<MD5Hit> hits;
+                md5_crack_single(singleInputs.data(), singleInputs.size(), target, hits, impl);
+                bool ok = hits.size() == expect.size();
+                for(size_t i = 0; ok && i < hits.size(); i++) {
+                    ok = hits[i].index == expect[i];
+                }
+                mismatches += !ok;
+            }
+        }
+        cout << "md5_crack_single: " << (mismatches == 0 ? "与MD5Hash完全一致" : "存在不一致!") << endl;
+        allCorrect = allCorrect && mismatches == 0;
+    }
+    delete[] largeInputs;
+    delete[] largeResults;
+    free(batchResults);
+    delete[] batchInputs;
+    delete[] batchSerial;
     
     cout << endl;
     cout << "测试" << (allCorrect ? "通过!" : "失败!") << endl;
@@ -1,7 +1,16 @@
 #include "PCFG.h"
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
 using namespace std;
 
-void PriorityQueue::CalProb(PT &pt)
+// 优先队列的堆序：概率低的PT排在概率高的PT之后，因此堆顶priority.front()是概率最高的PT
+static bool CompareByProb(const PT &a, const PT &b)
+{
+    return a.prob < b.prob;
+}
+
+void PriorityQueue::CalProb(PT &pt) const
 {
     // 计算PriorityQueue里面一个PT的流程如下：
     // 1. 首先需要计算一个PT本身的概率。例如，L6S1的概率为0.15
@@ -18,74 +27,88 @@ void PriorityQueue::CalProb(PT &pt)
 
     for (int idx : pt.curr_indices)
     {
-        // pt.content[index].PrintSeg();
-        if (pt.content[index].type == 1)
-        {
-            // 下面这行代码的意义：
-            // pt.content[index]：目前需要计算概率的segment
-            // m.FindLetter(seg): 找到一个letter segment在模型中的对应下标
-            // m.letters[m.FindLetter(seg)]：一个letter segment在模型中对应的所有统计数据
-            // m.letters[m.FindLetter(seg)].ordered_values：一个letter segment在模型中，所有value的总数目
-            pt.prob *= m.letters[m.FindLetter(pt.content[index])].ordered_freqs[idx];
-            pt.prob /= m.letters[m.FindLetter(pt.content[index])].total_freq;
-            // cout << m.letters[m.FindLetter(pt.content[index])].ordered_freqs[idx] << endl;
-            // cout << m.letters[m.FindLetter(pt.content[index])].total_freq << endl;
-        }
-        if (pt.content[index].type == 2)
-        {
-            pt.prob *= m.digits[m.FindDigit(pt.content[index])].ordered_freqs[idx];
-            pt.prob /= m.digits[m.FindDigit(pt.content[index])].total_freq;
-            // cout << m.digits[m.FindDigit(pt.content[index])].ordered_freqs[idx] << endl;
-            // cout << m.digits[m.FindDigit(pt.content[index])].total_freq << endl;
-        }
-        if (pt.content[index].type == 3)
-        {
-            pt.prob *= m.symbols[m.FindSymbol(pt.content[index])].ordered_freqs[idx];
-            pt.prob /= m.symbols[m.FindSymbol(pt.content[index])].total_freq;
-            // cout << m.symbols[m.FindSymbol(pt.content[index])].ordered_freqs[idx] << endl;
-            // cout << m.symbols[m.FindSymbol(pt.content[index])].total_freq << endl;
-        }
+        // 下面这几行代码的意义：
+        // pt.content[index]：目前需要计算概率的segment
+        // m.GetSegment(type, length)：按类型和长度直接找到这个segment在模型中对应的所有统计数据
+        // seg->freq(idx)：当前value的频数，seg->total_freq：该segment所有value的总频数
+        // 模型压缩后total_freq只包含保留下来的value，因此这里的概率自动重新归一
+        // CalProb只读模型，可以多线程调用。用到的value必须已经由调用者排好（见OrderIndices）
+        const SegmentStats *seg = m.GetSegment(pt.content[index].type, pt.content[index].length);
+        assert(idx < seg->ordered_count());
+        pt.prob *= seg->freq(idx);
+        pt.prob /= seg->total_freq;
+        // cout << seg->freq(idx) << endl;
+        // cout << seg->total_freq << endl;
         index += 1;
     }
     // cout << pt.prob << endl;
 }
 
+void PriorityQueue::OrderIndices(const PT &pt)
+{
+    for (int i = 0; i < pt.content.size(); i += 1)
+    {
+        m.GetSegment(pt.content[i].type, pt.content[i].length)->ensure_ordered(pt.curr_indices[i] + 1);
+    }
+}
+
+bool PasswordPolicy::Allows(const PT &pt) const
+{
+    int length = 0;
+    bool has_type[4] = {false, false, false, false};
+    for (const SegmentShape &seg : pt.content)
+    {
+        length += seg.length;
+        has_type[seg.type] = true;
+    }
+    int classes = has_type[1] + has_type[2] + has_type[3];
+    return length >= min_length && length <= max_length
+        && (!require_letter || has_type[1]) && (!require_digit || has_type[2]) && (!require_symbol || has_type[3])
+        && classes >= min_classes;
+}
+
 void PriorityQueue::init()
 {
     // cout << m.ordered_pts.size() << endl;
-    // 用所有可能的PT，按概率降序填满整个优先队列
-    for (PT pt : m.ordered_pts)
+    // 先并行地排好每个segment的第一段value。此后CalProb用到的都是第0个value，只读模型，可以多线程计算
+    m.ensure_ordered(1);
+
+    // 用所有可能的PT填满整个优先队列
+    // 各PT的max_indices和概率互不相关，并行计算后再一次性放入队列并建堆
+    int n = m.ordered_pts.size();
+    vector<PT> pts(n);
+    vector<char> allowed(n);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < n; i += 1)
     {
-        for (segment seg : pt.content)
+        // 不满足口令策略的PT不入队。NewPTs派生的PT与原PT结构相同，因此也无需再次判定
+        allowed[i] = policy.Allows(m.ordered_pts[i]);
+        if (!allowed[i])
         {
-            if (seg.type == 1)
-            {
-                // 下面这行代码的意义：
-                // max_indices用来表示PT中各个segment的可能数目。例如，L6S1中，假设模型统计到了100个L6，那么L6对应的最大下标就是99
-                // （但由于后面采用了"<"的比较关系，所以其实max_indices[0]=100）
-                // m.FindLetter(seg): 找到一个letter segment在模型中的对应下标
-                // m.letters[m.FindLetter(seg)]：一个letter segment在模型中对应的所有统计数据
-                // m.letters[m.FindLetter(seg)].ordered_values：一个letter segment在模型中，所有value的总数目
-                pt.max_indices.emplace_back(m.letters[m.FindLetter(seg)].ordered_values.size());
-            }
-            if (seg.type == 2)
-            {
-                pt.max_indices.emplace_back(m.digits[m.FindDigit(seg)].ordered_values.size());
-            }
-            if (seg.type == 3)
-            {
-                pt.max_indices.emplace_back(m.symbols[m.FindSymbol(seg)].ordered_values.size());
-            }
+            continue;
         }
-        pt.preterm_prob = float(m.preterm_freq[m.FindPT(pt)]) / m.total_preterm;
-        // pt.PrintPT();
-        // cout << " " << m.preterm_freq[m.FindPT(pt)] << " " << m.total_preterm << " " << pt.preterm_prob << endl;
-
+        PT &pt = pts[i];
+        pt = m.ordered_pts[i];
+        for (const SegmentShape &seg : pt.content)
+        {
+            // max_indices用来表示PT中各个segment的可能数目。例如，L6S1中，假设模型统计到了100个L6，那么L6对应的最大下标就是99
+            // （但由于后面采用了"<"的比较关系，所以其实max_indices[0]=100）
+            pt.max_indices.emplace_back(m.GetSegment(seg.type, seg.length)->value_count());
+        }
+        // pt.preterm_prob已经在model::order()中按preterm_freq / total_preterm计算好了
         // 计算当前pt的概率
         CalProb(pt);
-        // 将PT放入优先队列
-        priority.emplace_back(pt);
     }
+    for (int i = 0; i < n; i += 1)
+    {
+        if (allowed[i])
+        {
+            // 将PT放入优先队列
+            priority.emplace_back(move(pts[i]));
+        }
+    }
+    // 全部PT放入之后只建一次堆（线性时间），之后PopNext用堆操作出队和入队
+    make_heap(priority.begin(), priority.end(), CompareByProb);
     // cout << "priority size:" << priority.size() << endl;
 }
 
@@ -93,42 +116,40 @@ void PriorityQueue::PopNext()
 {
 
     // 对优先队列最前面的PT，首先利用这个PT生成一系列猜测
+    // 最后一个segment每次只输出从curr_indices[last]开始的LAST_SEGMENT_CHUNK个value
     Generate(priority.front());
 
     // 然后需要根据即将出队的PT，生成一系列新的PT
-    vector<PT> new_pts = priority.front().NewPTs();
-    for (PT pt : new_pts)
+    // 只有PT第一次出队（最后一个segment从第一个value开始）时才派生新的PT，之后的出队只是继续输出剩余的value
+    PT &front = priority.front();
+    int last = front.content.size() - 1;
+    vector<PT> new_pts;
+    if (front.curr_indices[last] == 0)
     {
-        // 计算概率
-        CalProb(pt);
-        // 接下来的这个循环，作用是根据概率，将新的PT插入到优先队列中
-        for (auto iter = priority.begin(); iter != priority.end(); iter++)
-        {
-            // 对于非队首和队尾的特殊情况
-            if (iter != priority.end() - 1 && iter != priority.begin())
-            {
-                // 判定概率
-                if (pt.prob <= iter->prob && pt.prob > (iter + 1)->prob)
-                {
-                    priority.emplace(iter + 1, pt);
-                    break;
-                }
-            }
-            if (iter == priority.end() - 1)
-            {
-                priority.emplace_back(pt);
-                break;
-            }
-            if (iter == priority.begin() && iter->prob < pt.prob)
-            {
-                priority.emplace(iter, pt);
-                break;
-            }
-        }
+        new_pts = front.NewPTs();
     }
+    // 最后一个segment还有未输出的value时，把剩余部分重新入队
+    // 它的概率由CalProb按下一个待输出的value计算，因此其他PT中概率更高的猜测可以先于这些value输出
+    if (front.curr_indices[last] + LAST_SEGMENT_CHUNK < front.max_indices[last])
+    {
+        PT rest = front;
+        rest.curr_indices[last] += LAST_SEGMENT_CHUNK;
+        new_pts.emplace_back(rest);
+    }
+
+    // 现在队首的PT善后工作已经结束，将其出队（从堆中删除）
+    pop_heap(priority.begin(), priority.end(), CompareByProb);
+    priority.pop_back();
 
-    // 现在队首的PT善后工作已经结束，将其出队（删除）
-    priority.erase(priority.begin());
+    for (PT &pt : new_pts)
+    {
+        // 先（串行地）排好新PT用到的value，再计算概率
+        OrderIndices(pt);
+        CalProb(pt);
+        // 根据概率，将新的PT插入到堆中
+        priority.emplace_back(move(pt));
+        push_heap(priority.begin(), priority.end(), CompareByProb);
+    }
 }
 
 // 这个函数你就算看不懂，对并行算法的实现影响也不大
@@ -188,28 +209,17 @@ void PriorityQueue::Generate(PT pt)
     if (pt.content.size() == 1)
     {
         // 指向最后一个segment的指针，这个指针实际指向模型中的统计数据
-        segment *a;
-        // 在模型中定位到这个segment
-        if (pt.content[0].type == 1)
-        {
-            a = &m.letters[m.FindLetter(pt.content[0])];
-        }
-        if (pt.content[0].type == 2)
-        {
-            a = &m.digits[m.FindDigit(pt.content[0])];
-        }
-        if (pt.content[0].type == 3)
-        {
-            a = &m.symbols[m.FindSymbol(pt.content[0])];
-        }
+        SegmentStats *a = m.GetSegment(pt.content[0].type, pt.content[0].length);
         
         // Multi-thread TODO：
         // 这个for循环就是你需要进行并行化的主要部分了，特别是在多线程&GPU编程任务中
         // 可以看到，这个循环本质上就是把模型中一个segment的所有value，赋值到PT中，形成一系列新的猜测
         // 这个过程是可以高度并行化的
-        for (int i = 0; i < pt.max_indices[0]; i += 1)
+        int end = min(pt.max_indices[0], pt.curr_indices[0] + LAST_SEGMENT_CHUNK);
+        a->ensure_ordered(end);
+        for (int i = pt.curr_indices[0]; i < end; i += 1)
         {
-            string guess = a->ordered_values[i];
+            string guess(a->value(i), a->length);
             // cout << guess << endl;
             guesses.emplace_back(guess);
             total_guesses += 1;
@@ -224,18 +234,8 @@ void PriorityQueue::Generate(PT pt)
         // 这个for循环你看不懂也没太大问题，并行算法不涉及这里的加速
         for (int idx : pt.curr_indices)
         {
-            if (pt.content[seg_idx].type == 1)
-            {
-                guess += m.letters[m.FindLetter(pt.content[seg_idx])].ordered_values[idx];
-            }
-            if (pt.content[seg_idx].type == 2)
-            {
-                guess += m.digits[m.FindDigit(pt.content[seg_idx])].ordered_values[idx];
-            }
-            if (pt.content[seg_idx].type == 3)
-            {
-                guess += m.symbols[m.FindSymbol(pt.content[seg_idx])].ordered_values[idx];
-            }
+            const SegmentStats *seg = m.GetSegment(pt.content[seg_idx].type, pt.content[seg_idx].length);
+            guess.append(seg->value(idx), seg->length);
             seg_idx += 1;
             if (seg_idx == pt.content.size() - 1)
             {
@@ -244,30 +244,156 @@ void PriorityQueue::Generate(PT pt)
         }
 
         // 指向最后一个segment的指针，这个指针实际指向模型中的统计数据
-        segment *a;
-        if (pt.content[pt.content.size() - 1].type == 1)
-        {
-            a = &m.letters[m.FindLetter(pt.content[pt.content.size() - 1])];
-        }
-        if (pt.content[pt.content.size() - 1].type == 2)
-        {
-            a = &m.digits[m.FindDigit(pt.content[pt.content.size() - 1])];
-        }
-        if (pt.content[pt.content.size() - 1].type == 3)
-        {
-            a = &m.symbols[m.FindSymbol(pt.content[pt.content.size() - 1])];
-        }
+        SegmentStats *a = m.GetSegment(pt.content.back().type, pt.content.back().length);
         
         // Multi-thread TODO：
         // 这个for循环就是你需要进行并行化的主要部分了，特别是在多线程&GPU编程任务中
         // 可以看到，这个循环本质上就是把模型中一个segment的所有value，赋值到PT中，形成一系列新的猜测
         // 这个过程是可以高度并行化的
-        for (int i = 0; i < pt.max_indices[pt.content.size() - 1]; i += 1)
+        int last = pt.content.size() - 1;
+        int end = min(pt.max_indices[last], pt.curr_indices[last] + LAST_SEGMENT_CHUNK);
+        a->ensure_ordered(end);
+        // value定长连续存放，每条猜测只需一次分配和两次定长拷贝
+        int prefix_len = guess.length();
+        for (int i = pt.curr_indices[last]; i < end; i += 1)
         {
-            string temp = guess + a->ordered_values[i];
-            // cout << temp << endl;
-            guesses.emplace_back(temp);
+            guesses.emplace_back(prefix_len + a->length, '\0');
+            char *temp = &guesses.back()[0];
+            memcpy(temp, guess.data(), prefix_len);
+            memcpy(temp + prefix_len, a->value(i), a->length);
+            // cout << guesses.back() << endl;
             total_guesses += 1;
         }
     }
-}
\ No newline at end of file
+}
+BandEnumerator::BandEnumerator(model &m, double top, double ratio) : m(m), top(top), ratio(ratio)
+{
+    // 分带枚举按名次二分查找和遍历value，并且各PT并行枚举，需要事先排好全部value
+    m.finish_order();
+    pt_segments.resize(m.ordered_pts.size());
+    rest_max.resize(m.ordered_pts.size());
+    for (int pt = 0; pt < m.ordered_pts.size(); pt += 1)
+    {
+        const vector<SegmentShape> &content = m.ordered_pts[pt].content;
+        rest_max[pt].assign(content.size() + 1, 1.0);
+        for (const SegmentShape &seg : content)
+        {
+            pt_segments[pt].push_back(m.GetSegment(seg.type, seg.length));
+        }
+        double value_min = 1;
+        for (int i = content.size() - 1; i >= 0; i -= 1)
+        {
+            const SegmentStats *seg = pt_segments[pt][i];
+            rest_max[pt][i] = rest_max[pt][i + 1] * seg->freq(0) / seg->total_freq;
+            value_min *= seg->freq(seg->value_count() - 1) / seg->total_freq;
+        }
+        min_prob = min(min_prob, m.ordered_pts[pt].preterm_prob * value_min);
+    }
+}
+
+double BandEnumerator::lower(int k) const
+{
+    return top * pow(ratio, k + 1);
+}
+
+double BandEnumerator::upper(int k) const
+{
+    return k == 0 ? INFINITY : top * pow(ratio, k);
+}
+
+int BandEnumerator::count() const
+{
+    // 与剪枝一样留有一点余量，min_prob与枚举时的乘法顺序不同
+    int k = 0;
+    while (lower(k) > min_prob * (1 - 1e-9))
+    {
+        k += 1;
+    }
+    return k + 1;
+}
+
+void BandEnumerator::enumerate(int k, vector<string> &guesses) const
+{
+    double low = lower(k);
+    double high = upper(k);
+    vector<vector<string>> pt_guesses(m.ordered_pts.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int pt = 0; pt < m.ordered_pts.size(); pt += 1)
+    {
+        enumerate(pt, low, high, pt_guesses[pt]);
+    }
+    for (vector<string> &list : pt_guesses)
+    {
+        for (string &guess : list)
+        {
+            guesses.emplace_back(move(guess));
+        }
+    }
+}
+
+void BandEnumerator::enumerate(int pt, double low, double high, vector<string> &guesses) const
+{
+    // 不满足口令策略的PT，以及整个PT的最大概率都达不到下界时直接跳过
+    if (!policy.Allows(m.ordered_pts[pt]) || m.ordered_pts[pt].preterm_prob * rest_max[pt][0] < low * (1 - 1e-9))
+    {
+        return;
+    }
+    string prefix;
+    descend(pt, 0, 1.0, low, high, prefix, guesses);
+}
+
+void BandEnumerator::descend(int pt, int depth, double value_prob, double low, double high, string &prefix, vector<string> &guesses) const
+{
+    const SegmentStats &seg = *pt_segments[pt][depth];
+    double preterm_prob = m.ordered_pts[pt].preterm_prob;
+    double total = seg.total_freq;
+
+    // 最后一个segment：value按频数降序排列，概率在[low, high)内的value是连续的一段，用二分查找确定
+    // 概率的计算顺序与Score相同：先累乘value的概率，再乘PT的概率
+    if (depth == pt_segments[pt].size() - 1)
+    {
+        auto prob = [&](int i)
+        { return preterm_prob * (value_prob * (seg.freq(i) / total)); };
+        // 在名次[0, n)上二分：第一个概率低于high的名次，以及第一个概率低于low的名次
+        auto first_below = [&](double bound)
+        {
+            int lo = 0, hi = seg.value_count();
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (prob(mid) >= bound)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            return lo;
+        };
+        int begin = first_below(high);
+        int end = first_below(low);
+        for (int i = begin; i < end; i += 1)
+        {
+            guesses.emplace_back(prefix);
+            guesses.back().append(seg.value(i), seg.length);
+        }
+        return;
+    }
+
+    // 中间的segment：一旦当前value加上后续segment的最优取值都达不到下界，后面更低频的value也不可能，停止
+    // 剪枝比较留有一点余量，避免不同的乘法顺序带来的舍入误差漏掉恰好等于下界的猜测
+    size_t prefix_len = prefix.length();
+    for (int i = 0; i < seg.value_count(); i += 1)
+    {
+        double next = value_prob * (seg.freq(i) / total);
+        if (preterm_prob * next * rest_max[pt][depth + 1] < low * (1 - 1e-9))
+        {
+            break;
+        }
+        prefix.append(seg.value(i), seg.length);
+        descend(pt, depth + 1, next, low, high, prefix, guesses);
+        prefix.resize(prefix_len);
+    }
+}
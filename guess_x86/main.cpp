@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include "PCFG.h"
 #include "md5.h"
 
 
@@ -10,6 +11,19 @@
 using namespace std;
 using namespace chrono;
 
+// 编译指令如下（所有文件都不使用-mavx2，md5_avx2.cpp内部以target("avx2")编译AVX2的内核）
+// g++ -O2 -fopenmp main.cpp train.cpp guessing.cpp eval.cpp md5.cpp md5_batch.cpp md5_avx2.cpp -o main
+//
+// 运行方式：./main               MD5性能测试，在随机字符串上比较串行与SSE版本的哈希时间
+//          ./main targets.txt   破解模式，训练PCFG并生成猜测，targets.txt每行一条十六进制MD5，只输出命中的口令
+//          ./main -e test.txt [curve.txt]
+//                               评估模式，生成过程中统计测试集的命中情况，结束时写出命中曲线（默认curve.txt）
+
+// 生成的猜测总数上限，与guess/main.cpp相同
+#define GUESS_LIMIT 10000000
+// 猜测每攒够这么多条就处理一批并清空
+#define GUESS_BATCH 1000000
+
 // 生成长度与示例近似的随机字符串
 void generateLongRandomString(char* str, int length) {
     static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -19,9 +33,100 @@ void generateLongRandomString(char* str, int length) {
     str[length] = '\0';
 }
 
-int main() {
+// 训练PCFG模型，按概率降序生成猜测，每攒够一批就交给process处理后清空，达到上限或队列为空时停止
+template <typename Process>
+void generateGuesses(Process process) {
+    PriorityQueue q;
+    auto start_train = high_resolution_clock::now();
+    q.m.train("/guessdata/Rockyou-singleLined-full.txt");
+    q.m.order();
+    auto end_train = high_resolution_clock::now();
+    cout << "Train time:" << duration_cast<microseconds>(end_train - start_train).count() / 1000000.0 << "seconds" << endl;
+    q.init();
+
+    size_t history = 0;
+    auto start = high_resolution_clock::now();
+    while (!q.priority.empty() && history + q.guesses.size() <= GUESS_LIMIT) {
+        q.PopNext();
+        if (q.guesses.size() > GUESS_BATCH) {
+            process(q.guesses);
+            history += q.guesses.size();
+            cout << "Guesses generated: " << history << endl;
+            q.guesses.clear();
+        }
+    }
+    // 最后一批不足GUESS_BATCH条的猜测
+    process(q.guesses);
+    history += q.guesses.size();
+    auto end = high_resolution_clock::now();
+    cout << "Guesses generated: " << history << endl;
+    cout << "Guess time:" << duration_cast<microseconds>(end - start).count() / 1000000.0 << "seconds" << endl;
+}
+
+// 破解模式：在核心中直接与目标摘要比较，只取回并输出命中的口令
+int crackTargets(const char* target_path) {
+    MD5TargetSet targets;
+    if (!md5_load_targets(target_path, targets)) {
+        cout << "无法打开目标文件: " << target_path << endl;
+        return 1;
+    }
+    cout << "目标摘要数: " << targets.digests.size() / 4 << endl;
+    // 只有一个目标时使用单目标模式，逆推最后几步以提前拒绝
+    MD5SingleTarget single_target;
+    bool single = targets.digests.size() == 4;
+    if (single) {
+        md5_prepare_single_target(targets.digests.data(), single_target);
+    }
+    // 第一次调用时会实测选择实现，放在生成猜测之前完成
+    cout << "MD5实现: " << md5_impl_name(md5_select_impl()) << endl;
+
+    size_t total_hits = 0;
+    generateGuesses([&](const vector<string>& guesses) {
+        vector<MD5Hit> hits;
+        if (single) {
+            md5_crack_single(guesses.data(), guesses.size(), single_target, hits);
+        } else {
+            md5_crack_batch(guesses.data(), guesses.size(), targets, hits);
+        }
+        for (const MD5Hit& hit : hits) {
+            cout << "Cracked: " << guesses[hit.index] << " ";
+            for (int j = 0; j < 4; j++) {
+                cout << setw(8) << setfill('0') << hex << hit.digest[j];
+            }
+            cout << dec << endl;
+        }
+        total_hits += hits.size();
+    });
+    cout << "Cracked:" << total_hits << endl;
+    return 0;
+}
+
+// 评估模式：生成的猜测不再哈希，而是直接与测试集比较
+int evaluateTestSet(const char* test_path, const string& curve_path) {
+    TestSetEvaluator evaluator;
+    if (!evaluator.load(test_path)) {
+        cout << "无法打开测试集: " << test_path << endl;
+        return 1;
+    }
+    cout << "测试集口令数: " << evaluator.total << endl;
+    generateGuesses([&](const vector<string>& guesses) {
+        evaluator.check(guesses);
+    });
+    evaluator.write_curve(curve_path);
+    cout << "Test set hits:" << evaluator.hits << "/" << evaluator.total << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     // 设置控制台编码
     system("chcp 65001");
+
+    if (argc > 2 && string(argv[1]) == "-e") {
+        return evaluateTestSet(argv[2], argc > 3 ? argv[3] : "curve.txt");
+    }
+    if (argc > 1) {
+        return crackTargets(argv[1]);
+    }
     
     cout << "====================== MD5性能测试 ======================" << endl;
     cout << "每轮测试: 10万条密码" << endl;
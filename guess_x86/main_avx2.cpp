@@ -95,30 +95,15 @@ int main() {
         
         auto start_avx = high_resolution_clock::now();
         
-        // 按批次调用AVX2版本 (每批8个)
-        for (int i = 0; i < DATA_SIZE; i += 8) {
-            int batch_size = (i + 8 <= DATA_SIZE) ? 8 : (DATA_SIZE - i);
-            
-            // 如果最后一批不足8个，需要补充到8个
-            if (batch_size < 8) {
-                for (int j = batch_size; j < 8; j++) {
-                    pw_array[i + j] = pw_array[i]; // 用重复数据填充
-                }
-                batch_size = 8;
-            }
-            
-            bit32* batch_results = new bit32[batch_size * 4];
-            
-            MD5Hash_AVX2(pw_array + i, batch_size, batch_results);
-            
-            // 拷贝结果（实际性能测试可以省略这一步，但为完整性保留）
-            int valid_results = min(8, DATA_SIZE - i);
-            for (int j = 0; j < valid_results; j++) {
-                memcpy(avx_results[i + j], batch_results + j * 4, 4 * sizeof(bit32));
-            }
-            
-            delete[] batch_results;
+        // 一次性调用AVX2版本，不足8个的尾部由MD5Hash_AVX2内部处理，不再改写pw_array
+        bit32* batch_results = new bit32[DATA_SIZE * 4];
+        MD5Hash_AVX2(pw_array, DATA_SIZE, batch_results, 2);
+        
+        // 拷贝结果（实际性能测试可以省略这一步，但为完整性保留）
+        for (int i = 0; i < DATA_SIZE; i++) {
+            memcpy(avx_results[i], batch_results + i * 4, 4 * sizeof(bit32));
         }
+        delete[] batch_results;
         
         auto end_avx = high_resolution_clock::now();
         auto duration_avx = duration_cast<microseconds>(end_avx - start_avx).count();
@@ -1,7 +1,11 @@
 #include "md5.h"
+#include "md5_core.h"
 #include <iomanip>
 #include <assert.h>
 #include <chrono>
+#include <algorithm>
+#include <array>
+#include <fstream>
 // 定义并行度，可以根据需要调整
 using namespace std;
 using namespace chrono;
@@ -27,7 +31,8 @@ Byte *StringProcess(string input, int *n_byte)
 	int paddingBits = bitLength % 512;
 	if (paddingBits > 448)
 	{
-		paddingBits += 512 - (paddingBits - 448);
+		// 先补到下一个512bit边界，再补448bit（原先多加了一次paddingBits，长度模64为57~63字节的消息会得到错误的填充长度）
+		paddingBits = 512 - paddingBits + 448;
 	}
 	else if (paddingBits < 448)
 	{
@@ -66,7 +71,7 @@ Byte *StringProcess(string input, int *n_byte)
 
 	// 验证长度是否满足要求。此时长度应当是512bit的倍数
 	int residual = 8 * paddedLength % 512;
-	// assert(residual == 0);
+	assert(residual == 0);
 
 	// 在填充+添加长度之后，消息被分为n_blocks个512bit的部分
 	*n_byte = paddedLength;
@@ -82,315 +87,51 @@ Byte *StringProcess(string input, int *n_byte)
  */
 void MD5Hash(string input, bit32 *state)
 {
+	int messageLength;
+	Byte *paddedMessage = StringProcess(input, &messageLength);
+	int n_blocks = messageLength / 64;
 
-	Byte *paddedMessage;
-	int *messageLength = new int[1];
-	for (int i = 0; i < 1; i += 1)
-	{
-		paddedMessage = StringProcess(input, &messageLength[i]);
-		// cout<<messageLength[i]<<endl;
-		assert(messageLength[i] == messageLength[0]);
-	}
-	int n_blocks = messageLength[0] / 64;
-
-	// bit32* state= new bit32[4];
-	state[0] = 0x67452301;
-	state[1] = 0xefcdab89;
-	state[2] = 0x98badcfe;
-	state[3] = 0x10325476;
-
-	// 逐block地更新state
-	for (int i = 0; i < n_blocks; i += 1)
-	{
-		bit32 x[16];
-
-		// 下面的处理，在理解上较为复杂
-		for (int i1 = 0; i1 < 16; ++i1)
-		{
-			x[i1] = (paddedMessage[4 * i1 + i * 64]) |
-					(paddedMessage[4 * i1 + 1 + i * 64] << 8) |
-					(paddedMessage[4 * i1 + 2 + i * 64] << 16) |
-					(paddedMessage[4 * i1 + 3 + i * 64] << 24);
-		}
-
-		bit32 a = state[0], b = state[1], c = state[2], d = state[3];
-
-		auto start = system_clock::now();
-		/* Round 1 */
-		FF(a, b, c, d, x[0], s11, 0xd76aa478);
-		FF(d, a, b, c, x[1], s12, 0xe8c7b756);
-		FF(c, d, a, b, x[2], s13, 0x242070db);
-		FF(b, c, d, a, x[3], s14, 0xc1bdceee);
-		FF(a, b, c, d, x[4], s11, 0xf57c0faf);
-		FF(d, a, b, c, x[5], s12, 0x4787c62a);
-		FF(c, d, a, b, x[6], s13, 0xa8304613);
-		FF(b, c, d, a, x[7], s14, 0xfd469501);
-		FF(a, b, c, d, x[8], s11, 0x698098d8);
-		FF(d, a, b, c, x[9], s12, 0x8b44f7af);
-		FF(c, d, a, b, x[10], s13, 0xffff5bb1);
-		FF(b, c, d, a, x[11], s14, 0x895cd7be);
-		FF(a, b, c, d, x[12], s11, 0x6b901122);
-		FF(d, a, b, c, x[13], s12, 0xfd987193);
-		FF(c, d, a, b, x[14], s13, 0xa679438e);
-		FF(b, c, d, a, x[15], s14, 0x49b40821);
-
-		/* Round 2 */
-		GG(a, b, c, d, x[1], s21, 0xf61e2562);
-		GG(d, a, b, c, x[6], s22, 0xc040b340);
-		GG(c, d, a, b, x[11], s23, 0x265e5a51);
-		GG(b, c, d, a, x[0], s24, 0xe9b6c7aa);
-		GG(a, b, c, d, x[5], s21, 0xd62f105d);
-		GG(d, a, b, c, x[10], s22, 0x2441453);
-		GG(c, d, a, b, x[15], s23, 0xd8a1e681);
-		GG(b, c, d, a, x[4], s24, 0xe7d3fbc8);
-		GG(a, b, c, d, x[9], s21, 0x21e1cde6);
-		GG(d, a, b, c, x[14], s22, 0xc33707d6);
-		GG(c, d, a, b, x[3], s23, 0xf4d50d87);
-		GG(b, c, d, a, x[8], s24, 0x455a14ed);
-		GG(a, b, c, d, x[13], s21, 0xa9e3e905);
-		GG(d, a, b, c, x[2], s22, 0xfcefa3f8);
-		GG(c, d, a, b, x[7], s23, 0x676f02d9);
-		GG(b, c, d, a, x[12], s24, 0x8d2a4c8a);
-
-		/* Round 3 */
-		HH(a, b, c, d, x[5], s31, 0xfffa3942);
-		HH(d, a, b, c, x[8], s32, 0x8771f681);
-		HH(c, d, a, b, x[11], s33, 0x6d9d6122);
-		HH(b, c, d, a, x[14], s34, 0xfde5380c);
-		HH(a, b, c, d, x[1], s31, 0xa4beea44);
-		HH(d, a, b, c, x[4], s32, 0x4bdecfa9);
-		HH(c, d, a, b, x[7], s33, 0xf6bb4b60);
-		HH(b, c, d, a, x[10], s34, 0xbebfbc70);
-		HH(a, b, c, d, x[13], s31, 0x289b7ec6);
-		HH(d, a, b, c, x[0], s32, 0xeaa127fa);
-		HH(c, d, a, b, x[3], s33, 0xd4ef3085);
-		HH(b, c, d, a, x[6], s34, 0x4881d05);
-		HH(a, b, c, d, x[9], s31, 0xd9d4d039);
-		HH(d, a, b, c, x[12], s32, 0xe6db99e5);
-		HH(c, d, a, b, x[15], s33, 0x1fa27cf8);
-		HH(b, c, d, a, x[2], s34, 0xc4ac5665);
-
-		/* Round 4 */
-		II(a, b, c, d, x[0], s41, 0xf4292244);
-		II(d, a, b, c, x[7], s42, 0x432aff97);
-		II(c, d, a, b, x[14], s43, 0xab9423a7);
-		II(b, c, d, a, x[5], s44, 0xfc93a039);
-		II(a, b, c, d, x[12], s41, 0x655b59c3);
-		II(d, a, b, c, x[3], s42, 0x8f0ccc92);
-		II(c, d, a, b, x[10], s43, 0xffeff47d);
-		II(b, c, d, a, x[1], s44, 0x85845dd1);
-		II(a, b, c, d, x[8], s41, 0x6fa87e4f);
-		II(d, a, b, c, x[15], s42, 0xfe2ce6e0);
-		II(c, d, a, b, x[6], s43, 0xa3014314);
-		II(b, c, d, a, x[13], s44, 0x4e0811a1);
-		II(a, b, c, d, x[4], s41, 0xf7537e82);
-		II(d, a, b, c, x[11], s42, 0xbd3af235);
-		II(c, d, a, b, x[2], s43, 0x2ad7d2bb);
-		II(b, c, d, a, x[9], s44, 0xeb86d391);
-
-		state[0] += a;
-		state[1] += b;
-		state[2] += c;
-		state[3] += d;
-	}
-
-	// 下面的处理，在理解上较为复杂
-	for (int i = 0; i < 4; i++)
-	{
-		uint32_t value = state[i];
-		state[i] = ((value & 0xff) << 24) |		 // 将最低字节移到最高位
-				   ((value & 0xff00) << 8) |	 // 将次低字节左移
-				   ((value & 0xff0000) >> 8) |	 // 将次高字节右移
-				   ((value & 0xff000000) >> 24); // 将最高字节移到最低位
-	}
-
-	// 输出最终的hash结果
-	// for (int i1 = 0; i1 < 4; i1 += 1)
-	// {
-	// 	cout << std::setw(8) << std::setfill('0') << hex << state[i1];
-	// }
-	// cout << endl;
+	// 标量版本与SIMD版本共用md5_core.h中的64步调度，只是向量宽度为1
+	MD5HashLanes<ScalarOps, 1>(&paddedMessage, &n_blocks, 1, state);
 
 	// 释放动态分配的内存
 	// 实现SIMD并行算法的时候，也请记得及时回收内存！
 	delete[] paddedMessage;
-	delete[] messageLength;
 }
 
-
-
-
-
 /**
  * MD5Hash_SSE: SSE并行版本的MD5实现
- * @param inputs 输入字符串数组，长度必须是SIMD_WIDTH的倍数
- * @param count 输入字符串的总数，必须是SIMD_WIDTH的倍数
+ * @param inputs 输入字符串数组
+ * @param count 输入字符串的总数；不是SIMD_WIDTH的倍数时，最后一批的空闲通道不输出结果
  * @param states 输出缓冲区，大小必须是count*4
+ * @param ways 交错处理的向量个数（1/2/3），剩余不足4*ways条的部分自动降为更少的路数
  */
-void MD5Hash_SSE(const string* inputs, int count, bit32* states)
+void MD5Hash_SSE(const string* inputs, int count, bit32* states, int ways)
 {
-    assert(count % SIMD_WIDTH == 0); // 确保输入数量是SIMD_WIDTH的倍数
-
     // 预处理所有输入字符串
     Byte** paddedMessages = new Byte*[count];
-    int* messageLengths = new int[count];
+    int* n_blocks = new int[count];
 
     // 对每个输入字符串进行预处理
     for (int i = 0; i < count; i++) {
-        paddedMessages[i] = StringProcess(inputs[i], &messageLengths[i]);
+        int messageLength;
+        paddedMessages[i] = StringProcess(inputs[i], &messageLength);
+        n_blocks[i] = messageLength / 64;
     }
 
-    // 按SIMD_WIDTH分组处理
-    for (int group = 0; group < count / SIMD_WIDTH; group++) {
-        int baseIndex = group * SIMD_WIDTH;
-
-        // 初始化状态向量
-        __m128i a = _mm_set1_epi32(0x67452301);
-        __m128i b = _mm_set1_epi32(0xefcdab89);
-        __m128i c = _mm_set1_epi32(0x98badcfe);
-        __m128i d = _mm_set1_epi32(0x10325476);
-
-        // 假设所有消息长度相同 (如果不同，需要更复杂的处理)
-        int n_blocks = messageLengths[baseIndex] / 64;
-
-        // 为每个block创建x数组
-        for (int i = 0; i < n_blocks; i++) {
-            __m128i x[16];
-
-            // 将四个输入的相同位置字节加载到SIMD寄存器中
-            for (int j = 0; j < 16; j++) {
-                bit32 values[SIMD_WIDTH];
-                
-                for (int k = 0; k < SIMD_WIDTH; k++) {
-                    int msgIdx = baseIndex + k;
-                    values[k] = (paddedMessages[msgIdx][4*j + i*64]) |
-                                (paddedMessages[msgIdx][4*j + 1 + i*64] << 8) |
-                                (paddedMessages[msgIdx][4*j + 2 + i*64] << 16) |
-                                (paddedMessages[msgIdx][4*j + 3 + i*64] << 24);
-                }
-                
-                x[j] = _mm_set_epi32(values[3], values[2], values[1], values[0]);
-            }
-
-            // 保存当前状态
-            __m128i aa = a, bb = b, cc = c, dd = d;
-
-            /* Round 1 */
-            FF_SSE(a, b, c, d, x[0], s11, 0xd76aa478);
-            FF_SSE(d, a, b, c, x[1], s12, 0xe8c7b756);
-            FF_SSE(c, d, a, b, x[2], s13, 0x242070db);
-            FF_SSE(b, c, d, a, x[3], s14, 0xc1bdceee);
-            FF_SSE(a, b, c, d, x[4], s11, 0xf57c0faf);
-            FF_SSE(d, a, b, c, x[5], s12, 0x4787c62a);
-            FF_SSE(c, d, a, b, x[6], s13, 0xa8304613);
-            FF_SSE(b, c, d, a, x[7], s14, 0xfd469501);
-            FF_SSE(a, b, c, d, x[8], s11, 0x698098d8);
-            FF_SSE(d, a, b, c, x[9], s12, 0x8b44f7af);
-            FF_SSE(c, d, a, b, x[10], s13, 0xffff5bb1);
-            FF_SSE(b, c, d, a, x[11], s14, 0x895cd7be);
-            FF_SSE(a, b, c, d, x[12], s11, 0x6b901122);
-            FF_SSE(d, a, b, c, x[13], s12, 0xfd987193);
-            FF_SSE(c, d, a, b, x[14], s13, 0xa679438e);
-            FF_SSE(b, c, d, a, x[15], s14, 0x49b40821);
-
-            /* Round 2 */
-            GG_SSE(a, b, c, d, x[1], s21, 0xf61e2562);
-            GG_SSE(d, a, b, c, x[6], s22, 0xc040b340);
-            GG_SSE(c, d, a, b, x[11], s23, 0x265e5a51);
-            GG_SSE(b, c, d, a, x[0], s24, 0xe9b6c7aa);
-            GG_SSE(a, b, c, d, x[5], s21, 0xd62f105d);
-            GG_SSE(d, a, b, c, x[10], s22, 0x2441453);
-            GG_SSE(c, d, a, b, x[15], s23, 0xd8a1e681);
-            GG_SSE(b, c, d, a, x[4], s24, 0xe7d3fbc8);
-            GG_SSE(a, b, c, d, x[9], s21, 0x21e1cde6);
-            GG_SSE(d, a, b, c, x[14], s22, 0xc33707d6);
-            GG_SSE(c, d, a, b, x[3], s23, 0xf4d50d87);
-            GG_SSE(b, c, d, a, x[8], s24, 0x455a14ed);
-            GG_SSE(a, b, c, d, x[13], s21, 0xa9e3e905);
-            GG_SSE(d, a, b, c, x[2], s22, 0xfcefa3f8);
-            GG_SSE(c, d, a, b, x[7], s23, 0x676f02d9);
-            GG_SSE(b, c, d, a, x[12], s24, 0x8d2a4c8a);
-
-            /* Round 3 */
-            HH_SSE(a, b, c, d, x[5], s31, 0xfffa3942);
-            HH_SSE(d, a, b, c, x[8], s32, 0x8771f681);
-            HH_SSE(c, d, a, b, x[11], s33, 0x6d9d6122);
-            HH_SSE(b, c, d, a, x[14], s34, 0xfde5380c);
-            HH_SSE(a, b, c, d, x[1], s31, 0xa4beea44);
-            HH_SSE(d, a, b, c, x[4], s32, 0x4bdecfa9);
-            HH_SSE(c, d, a, b, x[7], s33, 0xf6bb4b60);
-            HH_SSE(b, c, d, a, x[10], s34, 0xbebfbc70);
-            HH_SSE(a, b, c, d, x[13], s31, 0x289b7ec6);
-            HH_SSE(d, a, b, c, x[0], s32, 0xeaa127fa);
-            HH_SSE(c, d, a, b, x[3], s33, 0xd4ef3085);
-            HH_SSE(b, c, d, a, x[6], s34, 0x4881d05);
-            HH_SSE(a, b, c, d, x[9], s31, 0xd9d4d039);
-            HH_SSE(d, a, b, c, x[12], s32, 0xe6db99e5);
-            HH_SSE(c, d, a, b, x[15], s33, 0x1fa27cf8);
-            HH_SSE(b, c, d, a, x[2], s34, 0xc4ac5665);
-
-            /* Round 4 */
-            II_SSE(a, b, c, d, x[0], s41, 0xf4292244);
-            II_SSE(d, a, b, c, x[7], s42, 0x432aff97);
-            II_SSE(c, d, a, b, x[14], s43, 0xab9423a7);
-            II_SSE(b, c, d, a, x[5], s44, 0xfc93a039);
-            II_SSE(a, b, c, d, x[12], s41, 0x655b59c3);
-            II_SSE(d, a, b, c, x[3], s42, 0x8f0ccc92);
-            II_SSE(c, d, a, b, x[10], s43, 0xffeff47d);
-            II_SSE(b, c, d, a, x[1], s44, 0x85845dd1);
-            II_SSE(a, b, c, d, x[8], s41, 0x6fa87e4f);
-            II_SSE(d, a, b, c, x[15], s42, 0xfe2ce6e0);
-            II_SSE(c, d, a, b, x[6], s43, 0xa3014314);
-            II_SSE(b, c, d, a, x[13], s44, 0x4e0811a1);
-            II_SSE(a, b, c, d, x[4], s41, 0xf7537e82);
-            II_SSE(d, a, b, c, x[11], s42, 0xbd3af235);
-            II_SSE(c, d, a, b, x[2], s43, 0x2ad7d2bb);
-            II_SSE(b, c, d, a, x[9], s44, 0xeb86d391);
-
-            // 更新状态
-            a = _mm_add_epi32(a, aa);
-            b = _mm_add_epi32(b, bb);
-            c = _mm_add_epi32(c, cc);
-            d = _mm_add_epi32(d, dd);
-        }
-
-        // 存储结果到states数组
-        alignas(16) bit32 state_a[SIMD_WIDTH];
-        alignas(16) bit32 state_b[SIMD_WIDTH];
-        alignas(16) bit32 state_c[SIMD_WIDTH];
-        alignas(16) bit32 state_d[SIMD_WIDTH];
-        
-        _mm_store_si128((__m128i*)state_a, a);
-        _mm_store_si128((__m128i*)state_b, b);
-        _mm_store_si128((__m128i*)state_c, c);
-        _mm_store_si128((__m128i*)state_d, d);
-        
-        // 进行字节序调整并存储最终结果
-        for (int k = 0; k < SIMD_WIDTH; k++) {
-            int outputIdx = baseIndex + k;
-            
-            // 字节序调整
-            bit32 values[4] = {state_a[k], state_b[k], state_c[k], state_d[k]};
-            for (int i = 0; i < 4; i++) {
-                uint32_t value = values[i];
-                states[outputIdx*4 + i] = ((value & 0xff) << 24) |
-                                          ((value & 0xff00) << 8) |
-                                          ((value & 0xff0000) >> 8) |
-                                          ((value & 0xff000000) >> 24);
-            }
-        }
-    }
+    MD5HashMessages<SseOps>(paddedMessages, n_blocks, count, states, ways);
     
     // 释放内存
     for (int i = 0; i < count; i++) {
         delete[] paddedMessages[i];
     }
     delete[] paddedMessages;
-    delete[] messageLengths;
+    delete[] n_blocks;
 }
 
 /**
  * MD5Hash_SSE2: 2路并行版本的MD5实现
+ * 原先每个寄存器只使用两个通道；现在保留2的倍数的接口，内部与MD5Hash_SSE一样按4个通道满宽度计算
  * @param inputs 输入字符串数组
  * @param count 输入字符串的总数，必须是2的倍数
  * @param states 输出缓冲区，大小必须是count*4
@@ -399,166 +140,140 @@ void MD5Hash_SSE2(const string* inputs, int count, bit32* states)
 {
     // 确保输入数量是2的倍数
     assert(count % 2 == 0);
+    MD5Hash_SSE(inputs, count, states, 1);
+}
 
-    // 预处理所有输入字符串
-    Byte** paddedMessages = new Byte*[count];
-    int* messageLengths = new int[count];
-
-    // 对每个输入字符串进行预处理
-    for (int i = 0; i < count; i++) {
-        paddedMessages[i] = StringProcess(inputs[i], &messageLengths[i]);
+void md5_build_targets(const bit32 *digests, size_t count, MD5TargetSet &targets, int bits_per_key)
+{
+    vector<array<bit32, 4>> sorted(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(sorted[i].data(), digests + 4 * i, sizeof(sorted[i]));
     }
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
 
-    // 按2个一组进行处理
-    for (int batch = 0; batch < count; batch += 2) {
-        // 初始化状态向量
-        __m128i a = _mm_set1_epi32(0x67452301);
-        __m128i b = _mm_set1_epi32(0xefcdab89);
-        __m128i c = _mm_set1_epi32(0x98badcfe);
-        __m128i d = _mm_set1_epi32(0x10325476);
-        
-        // 验证两个消息长度相同
-        assert(messageLengths[batch] == messageLengths[batch + 1]);
-        //字符串有多少个512字，这个由输入字符串的长度决定，而不是输入字符串的数量
-        int n_blocks = messageLengths[batch] / 64;
-
-        // 处理每个block
-        for (int i = 0; i < n_blocks; i++) {
-            __m128i x[16];
-
-            // 将两个输入的相同位置字节加载到SIMD寄存器中
-            // 注意：虽然SSE寄存器可处理4个整数，但我们只使用前两个位置
-            for (int j = 0; j < 16; j++) {
-                bit32 values[2] = {0}; // 初始化为0
-                
-                // 只加载两个输入
-                for (int k = 0; k < 2; k++) {
-                    int msgIdx = batch + k;
-                    values[k] = (paddedMessages[msgIdx][4*j + i*64]) |
-                                (paddedMessages[msgIdx][4*j + 1 + i*64] << 8) |
-                                (paddedMessages[msgIdx][4*j + 2 + i*64] << 16) |
-                                (paddedMessages[msgIdx][4*j + 3 + i*64] << 24);
-                }
-                
-                
-                // 加载到SSE寄存器
-                x[j] = _mm_set_epi32(0,0, values[1], values[0]);
-            }
-
-            // 保存当前状态
-            __m128i aa = a, bb = b, cc = c, dd = d;
-
-            /* Round 1 */
-            FF_SSE(a, b, c, d, x[0], s11, 0xd76aa478);
-            FF_SSE(d, a, b, c, x[1], s12, 0xe8c7b756);
-            FF_SSE(c, d, a, b, x[2], s13, 0x242070db);
-            FF_SSE(b, c, d, a, x[3], s14, 0xc1bdceee);
-            FF_SSE(a, b, c, d, x[4], s11, 0xf57c0faf);
-            FF_SSE(d, a, b, c, x[5], s12, 0x4787c62a);
-            FF_SSE(c, d, a, b, x[6], s13, 0xa8304613);
-            FF_SSE(b, c, d, a, x[7], s14, 0xfd469501);
-            FF_SSE(a, b, c, d, x[8], s11, 0x698098d8);
-            FF_SSE(d, a, b, c, x[9], s12, 0x8b44f7af);
-            FF_SSE(c, d, a, b, x[10], s13, 0xffff5bb1);
-            FF_SSE(b, c, d, a, x[11], s14, 0x895cd7be);
-            FF_SSE(a, b, c, d, x[12], s11, 0x6b901122);
-            FF_SSE(d, a, b, c, x[13], s12, 0xfd987193);
-            FF_SSE(c, d, a, b, x[14], s13, 0xa679438e);
-            FF_SSE(b, c, d, a, x[15], s14, 0x49b40821);
-
-            /* Round 2 */
-            GG_SSE(a, b, c, d, x[1], s21, 0xf61e2562);
-            GG_SSE(d, a, b, c, x[6], s22, 0xc040b340);
-            GG_SSE(c, d, a, b, x[11], s23, 0x265e5a51);
-            GG_SSE(b, c, d, a, x[0], s24, 0xe9b6c7aa);
-            GG_SSE(a, b, c, d, x[5], s21, 0xd62f105d);
-            GG_SSE(d, a, b, c, x[10], s22, 0x2441453);
-            GG_SSE(c, d, a, b, x[15], s23, 0xd8a1e681);
-            GG_SSE(b, c, d, a, x[4], s24, 0xe7d3fbc8);
-            GG_SSE(a, b, c, d, x[9], s21, 0x21e1cde6);
-            GG_SSE(d, a, b, c, x[14], s22, 0xc33707d6);
-            GG_SSE(c, d, a, b, x[3], s23, 0xf4d50d87);
-            GG_SSE(b, c, d, a, x[8], s24, 0x455a14ed);
-            GG_SSE(a, b, c, d, x[13], s21, 0xa9e3e905);
-            GG_SSE(d, a, b, c, x[2], s22, 0xfcefa3f8);
-            GG_SSE(c, d, a, b, x[7], s23, 0x676f02d9);
-            GG_SSE(b, c, d, a, x[12], s24, 0x8d2a4c8a);
+    targets.digests.resize(sorted.size() * 4);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        memcpy(targets.digests.data() + 4 * i, sorted[i].data(), sizeof(sorted[i]));
+    }
 
-            /* Round 3 */
-            HH_SSE(a, b, c, d, x[5], s31, 0xfffa3942);
-            HH_SSE(d, a, b, c, x[8], s32, 0x8771f681);
-            HH_SSE(c, d, a, b, x[11], s33, 0x6d9d6122);
-            HH_SSE(b, c, d, a, x[14], s34, 0xfde5380c);
-            HH_SSE(a, b, c, d, x[1], s31, 0xa4beea44);
-            HH_SSE(d, a, b, c, x[4], s32, 0x4bdecfa9);
-            HH_SSE(c, d, a, b, x[7], s33, 0xf6bb4b60);
-            HH_SSE(b, c, d, a, x[10], s34, 0xbebfbc70);
-            HH_SSE(a, b, c, d, x[13], s31, 0x289b7ec6);
-            HH_SSE(d, a, b, c, x[0], s32, 0xeaa127fa);
-            HH_SSE(c, d, a, b, x[3], s33, 0xd4ef3085);
-            HH_SSE(b, c, d, a, x[6], s34, 0x4881d05);
-            HH_SSE(a, b, c, d, x[9], s31, 0xd9d4d039);
-            HH_SSE(d, a, b, c, x[12], s32, 0xe6db99e5);
-            HH_SSE(c, d, a, b, x[15], s33, 0x1fa27cf8);
-            HH_SSE(b, c, d, a, x[2], s34, 0xc4ac5665);
+    // 核心中的状态字还没有做字节序调整，第一级比较直接使用调整前的形式
+    targets.first_words.clear();
+    targets.filter.clear();
+    targets.filter_blocks = 0;
+    if (sorted.size() <= MD5_CRACK_BROADCAST_MAX)
+    {
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            targets.first_words.push_back(__builtin_bswap32(sorted[i][0]));
+        }
+        sort(targets.first_words.begin(), targets.first_words.end());
+        targets.first_words.erase(unique(targets.first_words.begin(), targets.first_words.end()), targets.first_words.end());
+        return;
+    }
 
-            /* Round 4 */
-            II_SSE(a, b, c, d, x[0], s41, 0xf4292244);
-            II_SSE(d, a, b, c, x[7], s42, 0x432aff97);
-            II_SSE(c, d, a, b, x[14], s43, 0xab9423a7);
-            II_SSE(b, c, d, a, x[5], s44, 0xfc93a039);
-            II_SSE(a, b, c, d, x[12], s41, 0x655b59c3);
-            II_SSE(d, a, b, c, x[3], s42, 0x8f0ccc92);
-            II_SSE(c, d, a, b, x[10], s43, 0xffeff47d);
-            II_SSE(b, c, d, a, x[1], s44, 0x85845dd1);
-            II_SSE(a, b, c, d, x[8], s41, 0x6fa87e4f);
-            II_SSE(d, a, b, c, x[15], s42, 0xfe2ce6e0);
-            II_SSE(c, d, a, b, x[6], s43, 0xa3014314);
-            II_SSE(b, c, d, a, x[13], s44, 0x4e0811a1);
-            II_SSE(a, b, c, d, x[4], s41, 0xf7537e82);
-            II_SSE(d, a, b, c, x[11], s42, 0xbd3af235);
-            II_SSE(c, d, a, b, x[2], s43, 0x2ad7d2bb);
-            II_SSE(b, c, d, a, x[9], s44, 0xeb86d391);
+    // 每块256位
+    size_t blocks = (sorted.size() * bits_per_key + 255) / 256;
+    targets.filter_blocks = (bit32)(blocks > 0 ? blocks : 1);
+    targets.filter.assign(8 * (size_t)targets.filter_blocks, 0);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        MD5FilterInsert(targets.filter.data(), targets.filter_blocks, __builtin_bswap32(sorted[i][0]));
+    }
+}
 
-            // 更新状态
-            a = _mm_add_epi32(a, aa);
-            b = _mm_add_epi32(b, bb);
-            c = _mm_add_epi32(c, cc);
-            d = _mm_add_epi32(d, dd);
+// 把32个十六进制字符解码为与MD5Hash输出相同字节序的4个bit32，含有非十六进制字符时返回false
+// 每次用一个128位寄存器处理16个字符：分别按数字和字母（大小写合并）计算半字节的值，再把相邻的两个半字节拼成一个字节
+static bool DecodeHexDigest(const char *hex, bit32 *digest)
+{
+    alignas(16) Byte bytes[16];
+#if defined(__ARM_NEON)
+    // vld2q_u8把偶数位置（高半字节）和奇数位置（低半字节）的字符分别装入两个寄存器
+    uint8x16x2_t chars = vld2q_u8((const uint8_t *)hex);
+    uint8x16_t nibbles[2];
+    uint8x16_t valid = vdupq_n_u8(0xff);
+    for (int k = 0; k < 2; k++)
+    {
+        uint8x16_t c = chars.val[k];
+        uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+        uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+        uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+        valid = vandq_u8(valid, vorrq_u8(is_digit, is_alpha));
+        nibbles[k] = vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+    }
+    if (vminvq_u8(valid) != 0xff)
+        return false;
+    vst1q_u8(bytes, vorrq_u8(vshlq_n_u8(nibbles[0], 4), nibbles[1]));
+#elif defined(__SSE2__)
+    __m128i packed[2];
+    for (int k = 0; k < 2; k++)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i *)(hex + 16 * k));
+        __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+        // 有符号比较：0x80以上的字节是负数，不会落在任何一个范围中
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+        __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff)
+            return false;
+        __m128i v = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                                 _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+        // 每个16位通道中低字节是高半字节、高字节是低半字节，合并后的字节放在低8位
+        packed[k] = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00f0)), _mm_srli_epi16(v, 8));
+    }
+    _mm_store_si128((__m128i *)bytes, _mm_packus_epi16(packed[0], packed[1]));
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        int v[2];
+        for (int k = 0; k < 2; k++)
+        {
+            char c = hex[2 * i + k];
+            v[k] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (v[k] < 0)
+                return false;
         }
+        bytes[i] = v[0] << 4 | v[1];
+    }
+#endif
+    for (int r = 0; r < 4; r++)
+    {
+        digest[r] = (bit32)bytes[4 * r] << 24 | bytes[4 * r + 1] << 16 | bytes[4 * r + 2] << 8 | bytes[4 * r + 3];
+    }
+    return true;
+}
 
-        // 存储结果到states数组
-        //初始化数组
-        alignas(16) bit32 state_a[4];
-        alignas(16) bit32 state_b[4];
-        alignas(16) bit32 state_c[4];
-        alignas(16) bit32 state_d[4];
-        
-        _mm_store_si128((__m128i*)state_a, a);
-        _mm_store_si128((__m128i*)state_b, b);
-        _mm_store_si128((__m128i*)state_c, c);
-        _mm_store_si128((__m128i*)state_d, d);
-        
-        // 只处理前两个通道的结果
-        for (int k = 0; k < 2; k++) {
-            int outputIdx = batch + k;
-            
-            // 字节序调整
-            bit32 values[4] = {state_a[k], state_b[k], state_c[k], state_d[k]};
-            for (int i = 0; i < 4; i++) {
-                uint32_t value = values[i];
-                states[outputIdx*4 + i] = ((value & 0xff) << 24) |
-                                          ((value & 0xff00) << 8) |
-                                          ((value & 0xff0000) >> 8) |
-                                          ((value & 0xff000000) >> 24);
-            }
+bool md5_load_targets(const string &path, MD5TargetSet &targets, int bits_per_key)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    vector<bit32> digests;
+    bit32 digest[4];
+    const char *p = text.data(), *end = text.data() + text.size();
+    while (p < end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+        if (eol - p >= 32 && DecodeHexDigest(p, digest))
+        {
+            digests.insert(digests.end(), digest, digest + 4);
         }
+        p = eol + 1;
     }
-    
-    // 释放内存
-    for (int i = 0; i < count; i++) {
-        delete[] paddedMessages[i];
-    }
-    delete[] paddedMessages;
-    delete[] messageLengths;
+    md5_build_targets(digests.data(), digests.size() / 4, targets, bits_per_key);
+    return true;
+}
+
+void md5_prepare_single_target(const bit32 *digest, MD5SingleTarget &target)
+{
+    memcpy(target.digest, digest, sizeof(target.digest));
+    const bit32 zero[16] = {0};
+    MD5ReverseState(digest, zero, target.reversed_zero);
+    md5_build_targets(digest, 1, target.set);
 }
@@ -1,8 +1,10 @@
+#ifndef MD5_H
+#define MD5_H
+
 #include <iostream>
 #include <string>
 #include <cstring>
-#include <emmintrin.h>  // SSE2 指令集
-#include <tmmintrin.h>  // SSSE3 指令集
+#include <vector>
 #ifndef SIMD_WIDTH
 #define SIMD_WIDTH 4  // SSE指令集自然并行宽度为4
 #endif
@@ -84,62 +86,132 @@ Byte *StringProcess(string input, int *n_byte);
   (a) += (b); \
 }
 
+// 64步的调度（消息字下标、移位量、常数）以及标量/SSE2/AVX2的具体实现见md5_core.h
 void MD5Hash(string input, bit32 *state);
-// ...existing code...
+/**
+ * MD5Hash_SSE: SSE并行版本的MD5实现
+ * @param count 输入字符串的总数；不是SIMD_WIDTH的倍数时，最后一批的空闲通道不输出结果
+ * @param ways 交错处理的向量个数（1/2/3，即每批4/8/12条消息），可根据CPU的流水线情况选择
+ */
+void MD5Hash_SSE(const string* inputs, int count, bit32* states, int ways = 1);
+/**
+ * MD5Hash_SSE2: 2路并行版本的MD5实现
+ * @param inputs 输入字符串数组
+ * @param count 输入字符串的总数，必须是2的倍数
+ * @param states 输出缓冲区，大小必须是count*4
+ */
+void MD5Hash_SSE2(const string* inputs, int count, bit32* states);
+
+// 统一的批量接口可用的实现，md5_batch在第一次调用时根据CPU（CPUID）选择
+// *_SCALAR1/2为混合内核：每批在向量之外再用标量整数单元交错计算1/2条消息
+enum MD5Impl
+{
+    MD5_IMPL_SCALAR,
+    MD5_IMPL_SSE2,
+    MD5_IMPL_AVX2,
+    MD5_IMPL_SSE2_SCALAR1,
+    MD5_IMPL_SSE2_SCALAR2,
+    MD5_IMPL_AVX2_SCALAR1,
+    MD5_IMPL_AVX2_SCALAR2,
+};
 
+/**
+ * md5_select_impl: 检测当前CPU支持的实现，并在其中实测选出最快的一个（包括混合内核），结果在第一次调用后缓存
+ */
+MD5Impl md5_select_impl();
 
+/**
+ * md5_impl_name: 实现的名称，便于在测试和性能报告中输出
+ */
+const char *md5_impl_name(MD5Impl impl);
 
-// SSE 版本的基础函数,适用于 AMD CPU
-#define F_SSE(x, y, z) _mm_or_si128(_mm_and_si128((x), (y)), _mm_andnot_si128((x), (z))) 
-#define G_SSE(x, y, z) _mm_or_si128(_mm_and_si128((x), (z)), _mm_and_si128((y), _mm_andnot_si128((z), _mm_set1_epi32(-1))))
-#define H_SSE(x, y, z) _mm_xor_si128(_mm_xor_si128((x), (y)), (z))
-#define I_SSE(x, y, z) _mm_xor_si128((y), _mm_or_si128((x), _mm_andnot_si128((z), _mm_set1_epi32(-1))))
+/**
+ * md5_batch: 统一的批量MD5接口，实现位于md5_batch.cpp（需要同时链接md5_avx2.cpp）
+ * @param inputs 连续的输入字符串数组，不会被修改
+ * @param count 输入字符串的总数，可以是任意值，不足一批的尾部在内部处理
+ * @param[out] digests 连续的摘要数组，大小为count*4，第i条消息的结果位于digests[4*i..4*i+3]，建议按32字节对齐
+ */
+void md5_batch(const string *inputs, size_t count, bit32 *digests);
 
-// SSE 版本的左旋转
-#define ROTATELEFT_SSE(x, n) \
-    _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), (32-(n))))
+/**
+ * md5_batch: 指定实现的版本，用于正确性测试和性能对比
+ */
+void md5_batch(const string *inputs, size_t count, bit32 *digests, MD5Impl impl);
+
+// ==================== 破解模式 ====================
+
+// 目标摘要集合，由md5_build_targets或md5_load_targets建立
+struct MD5TargetSet
+{
+    // 目标摘要（与MD5Hash输出相同的字节序），按字典序排序并去重，每条占4个bit32
+    vector<bit32> digests;
+    // 目标较少时：每条目标摘要第一个字在压缩函数中的原始形式（即未做字节序调整的状态a），第一级比较直接广播比较
+    vector<bit32> first_words;
+    // 目标较多时：以同一个字为键的分块Bloom过滤器（每块8个bit32），第一级比较改为查询过滤器
+    vector<bit32> filter;
+    bit32 filter_blocks = 0;
+};
+
+// 一次命中：输入下标与对应的摘要
+struct MD5Hit
+{
+    size_t index;
+    bit32 digest[4];
+};
 
-// SSE 版本的轮函数
-#define FF_SSE(a, b, c, d, x, s, ac) { \
-    __m128i tmp = F_SSE((b), (c), (d)); \
-    tmp = _mm_add_epi32(tmp, (x)); \
-    tmp = _mm_add_epi32(tmp, _mm_set1_epi32(ac)); \
-    (a) = _mm_add_epi32((a), tmp); \
-    (a) = ROTATELEFT_SSE((a), (s)); \
-    (a) = _mm_add_epi32((a), (b)); \
-}
+/**
+ * md5_build_targets: 由若干条摘要（与MD5Hash输出相同的字节序）建立目标集合
+ * @param bits_per_key 过滤器每个目标占用的位数：越大误报越少，越小越容易留在缓存中（12位时误报率约0.5%）
+ */
+void md5_build_targets(const bit32 *digests, size_t count, MD5TargetSet &targets, int bits_per_key = 12);
 
-#define GG_SSE(a, b, c, d, x, s, ac) { \
-    __m128i tmp = G_SSE((b), (c), (d)); \
-    tmp = _mm_add_epi32(tmp, (x)); \
-    tmp = _mm_add_epi32(tmp, _mm_set1_epi32(ac)); \
-    (a) = _mm_add_epi32((a), tmp); \
-    (a) = ROTATELEFT_SSE((a), (s)); \
-    (a) = _mm_add_epi32((a), (b)); \
-}
+/**
+ * md5_load_targets: 从文本文件读取目标摘要，每行一条32位十六进制的MD5，无法解析的行被跳过
+ * 整个文件一次读入，十六进制用SIMD一次解码16个字符
+ * @return 文件能否打开
+ */
+bool md5_load_targets(const string &path, MD5TargetSet &targets, int bits_per_key = 12);
 
-#define HH_SSE(a, b, c, d, x, s, ac) { \
-    __m128i tmp = H_SSE((b), (c), (d)); \
-    tmp = _mm_add_epi32(tmp, (x)); \
-    tmp = _mm_add_epi32(tmp, _mm_set1_epi32(ac)); \
-    (a) = _mm_add_epi32((a), tmp); \
-    (a) = ROTATELEFT_SSE((a), (s)); \
-    (a) = _mm_add_epi32((a), (b)); \
-}
+/**
+ * md5_crack_batch: 计算每条输入的MD5并与目标集合比较，只把命中的(输入下标, 摘要)追加到hits中
+ * 比较在最终状态还在寄存器中时完成，未命中的消息不写回任何摘要
+ */
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits);
 
-#define II_SSE(a, b, c, d, x, s, ac) { \
-    __m128i tmp = I_SSE((b), (c), (d)); \
-    tmp = _mm_add_epi32(tmp, (x)); \
-    tmp = _mm_add_epi32(tmp, _mm_set1_epi32(ac)); \
-    (a) = _mm_add_epi32((a), tmp); \
-    (a) = ROTATELEFT_SSE((a), (s)); \
-    (a) = _mm_add_epi32((a), (b)); \
-}
-void MD5Hash_SSE(const string* inputs, int count, bit32* states);
 /**
- * MD5Hash_SSE2: 2路并行版本的MD5实现
- * @param inputs 输入字符串数组
- * @param count 输入字符串的总数，必须是2的倍数
- * @param states 输出缓冲区，大小必须是count*4
+ * md5_crack_batch: 指定实现的版本，用于正确性测试和性能对比
  */
-void MD5Hash_SSE2(const string* inputs, int count, bit32* states);
\ No newline at end of file
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits,
+                     MD5Impl impl);
+
+// ==================== 单目标模式 ====================
+
+// 只破解一个目标时的预处理结果，由md5_prepare_single_target建立
+struct MD5SingleTarget
+{
+    // 目标摘要（与MD5Hash输出相同的字节序）
+    bit32 digest[4];
+    // 被逆推的最后几步所用的消息字全为0（短口令）时，逆推得到的中间状态，只需算一次
+    bit32 reversed_zero[4];
+    // 不能走逆推路径的批次（多块消息等）退回普通破解模式时使用的目标集合
+    MD5TargetSet set;
+};
+
+/**
+ * md5_prepare_single_target: 为单个目标预先逆推最后几步的状态
+ */
+void md5_prepare_single_target(const bit32 *digest, MD5SingleTarget &target);
+
+/**
+ * md5_crack_single: 单目标破解：单块消息只计算前60步就与逆推的状态比较，提前拒绝绝大多数候选
+ * 结果与md5_crack_batch以这一个目标建立的集合完全相同
+ */
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits);
+
+/**
+ * md5_crack_single: 指定实现的版本，用于正确性测试和性能对比（混合内核按对应的纯向量实现处理）
+ */
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits,
+                      MD5Impl impl);
+
+#endif // MD5_H
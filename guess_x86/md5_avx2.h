@@ -2,7 +2,7 @@
 #define MD5_AVX2_H
 
 #include <string>
-#include <immintrin.h> // 包含AVX2指令集
+#include "md5.h" // MD5TargetSet、MD5Hit
 
 using namespace std;
 
@@ -14,9 +14,29 @@ typedef unsigned int bit32;
 /**
  * MD5Hash_AVX2: AVX2 8路并行版本的MD5实现
  * @param inputs 输入字符串数组
- * @param count 输入字符串的总数，必须是8的倍数
+ * @param count 输入字符串的总数；不是8的倍数时，最后一批的空闲通道不输出结果
  * @param states 输出缓冲区，大小必须是count*4
+ * @param ways 交错处理的向量个数（1/2/3，即每批8/16/24条消息），可根据CPU的流水线情况选择
  */
-void MD5Hash_AVX2(const string* inputs, int count, bit32* states);
+void MD5Hash_AVX2(const string* inputs, int count, bit32* states, int ways = 1);
+
+/**
+ * MD5Hash_AVX2_Batch: md5_batch的AVX2实现，输入与输出的约定与md5_batch相同
+ * scalar_lanes为每批额外交错计算的标量消息数（0/1/2）
+ * 只应在CPU支持AVX2时调用（见md5_batch.cpp中的运行时检测）
+ */
+void MD5Hash_AVX2_Batch(const string* inputs, size_t count, bit32* digests, int ways, int scalar_lanes = 0);
+
+/**
+ * MD5Hash_AVX2_Crack: md5_crack_batch的AVX2实现，只应在CPU支持AVX2时调用
+ */
+void MD5Hash_AVX2_Crack(const string* inputs, size_t count, const MD5TargetSet& targets, vector<MD5Hit>& hits,
+                        int ways, int scalar_lanes = 0);
+
+/**
+ * MD5Hash_AVX2_CrackSingle: md5_crack_single的AVX2实现，只应在CPU支持AVX2时调用
+ */
+void MD5Hash_AVX2_CrackSingle(const string* inputs, size_t count, const MD5SingleTarget& target, vector<MD5Hit>& hits,
+                              int ways);
 
 #endif // MD5_AVX2_H
\ No newline at end of file
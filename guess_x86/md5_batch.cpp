@@ -0,0 +1,154 @@
+#include "md5.h"
+#include "md5_avx2.h"
+#include "md5_core.h"
+
+// 统一的批量接口：按CPUID在标量、SSE2、AVX2之间选择
+// AVX2的实现位于md5_avx2.cpp中，只有其中的内核以target("avx2")编译，只有CPU支持时才会调用
+// 编译示例：
+// g++ -O2 -fopenmp main.cpp train.cpp guessing.cpp md5.cpp md5_batch.cpp md5_avx2.cpp -o main
+// 加上-fopenmp后，较大的批次会分给多个线程（见md5_core.h中的MD5HashBatch）
+
+// 批量接口默认的交错路数
+#define MD5_BATCH_WAYS 2
+
+MD5Impl md5_select_impl()
+{
+    static const MD5Impl selected = []() {
+        __builtin_cpu_init();
+        auto run = [](const string *inputs, size_t count, bit32 *digests, MD5Impl impl) {
+            md5_batch(inputs, count, digests, impl);
+        };
+        if (__builtin_cpu_supports("avx2"))
+        {
+            const MD5Impl candidates[] = {MD5_IMPL_AVX2, MD5_IMPL_AVX2_SCALAR1, MD5_IMPL_AVX2_SCALAR2};
+            return MD5Autotune(candidates, 3, run);
+        }
+#if defined(__SSE2__)
+        const MD5Impl candidates[] = {MD5_IMPL_SSE2, MD5_IMPL_SSE2_SCALAR1, MD5_IMPL_SSE2_SCALAR2};
+        return MD5Autotune(candidates, 3, run);
+#else
+        return MD5_IMPL_SCALAR;
+#endif
+    }();
+    return selected;
+}
+
+const char *md5_impl_name(MD5Impl impl)
+{
+    switch (impl)
+    {
+    case MD5_IMPL_SSE2:
+        return "SSE2";
+    case MD5_IMPL_AVX2:
+        return "AVX2";
+    case MD5_IMPL_SSE2_SCALAR1:
+        return "SSE2+1标量";
+    case MD5_IMPL_SSE2_SCALAR2:
+        return "SSE2+2标量";
+    case MD5_IMPL_AVX2_SCALAR1:
+        return "AVX2+1标量";
+    case MD5_IMPL_AVX2_SCALAR2:
+        return "AVX2+2标量";
+    default:
+        return "scalar";
+    }
+}
+
+void md5_batch(const string *inputs, size_t count, bit32 *digests, MD5Impl impl)
+{
+    switch (impl)
+    {
+    case MD5_IMPL_AVX2:
+        MD5Hash_AVX2_Batch(inputs, count, digests, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_AVX2_SCALAR1:
+        MD5Hash_AVX2_Batch(inputs, count, digests, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_AVX2_SCALAR2:
+        MD5Hash_AVX2_Batch(inputs, count, digests, MD5_BATCH_WAYS, 2);
+        break;
+#if defined(__SSE2__)
+    case MD5_IMPL_SSE2:
+        MD5HashBatch<SseOps>(inputs, count, digests, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_SSE2_SCALAR1:
+        MD5HashBatch<SseOps>(inputs, count, digests, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_SSE2_SCALAR2:
+        MD5HashBatch<SseOps>(inputs, count, digests, MD5_BATCH_WAYS, 2);
+        break;
+#endif
+    default:
+        MD5HashBatch<ScalarOps>(inputs, count, digests, 1);
+        break;
+    }
+}
+
+void md5_batch(const string *inputs, size_t count, bit32 *digests)
+{
+    md5_batch(inputs, count, digests, md5_select_impl());
+}
+
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits,
+                     MD5Impl impl)
+{
+    switch (impl)
+    {
+    case MD5_IMPL_AVX2:
+        MD5Hash_AVX2_Crack(inputs, count, targets, hits, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_AVX2_SCALAR1:
+        MD5Hash_AVX2_Crack(inputs, count, targets, hits, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_AVX2_SCALAR2:
+        MD5Hash_AVX2_Crack(inputs, count, targets, hits, MD5_BATCH_WAYS, 2);
+        break;
+#if defined(__SSE2__)
+    case MD5_IMPL_SSE2:
+        MD5CrackBatch<SseOps>(inputs, count, targets, hits, MD5_BATCH_WAYS);
+        break;
+    case MD5_IMPL_SSE2_SCALAR1:
+        MD5CrackBatch<SseOps>(inputs, count, targets, hits, MD5_BATCH_WAYS, 1);
+        break;
+    case MD5_IMPL_SSE2_SCALAR2:
+        MD5CrackBatch<SseOps>(inputs, count, targets, hits, MD5_BATCH_WAYS, 2);
+        break;
+#endif
+    default:
+        MD5CrackBatch<ScalarOps>(inputs, count, targets, hits, 1);
+        break;
+    }
+}
+
+void md5_crack_batch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits)
+{
+    md5_crack_batch(inputs, count, targets, hits, md5_select_impl());
+}
+
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits,
+                      MD5Impl impl)
+{
+    switch (impl)
+    {
+    case MD5_IMPL_AVX2:
+    case MD5_IMPL_AVX2_SCALAR1:
+    case MD5_IMPL_AVX2_SCALAR2:
+        MD5Hash_AVX2_CrackSingle(inputs, count, target, hits, MD5_BATCH_WAYS);
+        break;
+#if defined(__SSE2__)
+    case MD5_IMPL_SSE2:
+    case MD5_IMPL_SSE2_SCALAR1:
+    case MD5_IMPL_SSE2_SCALAR2:
+        MD5CrackSingleBatch<SseOps>(inputs, count, target, hits, MD5_BATCH_WAYS);
+        break;
+#endif
+    default:
+        MD5CrackSingleBatch<ScalarOps>(inputs, count, target, hits, 1);
+        break;
+    }
+}
+
+void md5_crack_single(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits)
+{
+    md5_crack_single(inputs, count, target, hits, md5_select_impl());
+}
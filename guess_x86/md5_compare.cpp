@@ -29,7 +29,10 @@ int main() {
     
     cout << "================= MD5哈希并行度对比测试 =================" << endl;
     cout << "CPU型号: AMD Ryzen 7 7840H" << endl;
-    cout << "测试内容: 串行vs2路SSE2 vs4路SSE vs8路AVX2" << endl;
+    cout << "测试内容: 串行vs2路SSE2 vs4路SSE vs8路AVX2 vs混合内核(md5_batch自动调优)" << endl;
+    // 第一次调用时实测选出最快的实现，放在计时之外
+    MD5Impl tuned = md5_select_impl();
+    cout << "自动调优选择的实现: " << md5_impl_name(tuned) << endl;
     cout << "=========================================================" << endl << endl;
     
     // 创建CSV文件
@@ -40,7 +43,7 @@ int main() {
     }
     
     // 写入CSV文件头
-    csvFile << "数据量,密码长度,串行(秒),2路SSE2(秒),4路SSE(秒),8路AVX2(秒),2路加速比,4路加速比,8路加速比" << endl;
+    csvFile << "数据量,密码长度,串行(秒),2路SSE2(秒),4路SSE(秒),8路AVX2(秒),混合(秒),2路加速比,4路加速比,8路加速比,混合加速比" << endl;
     
     // 初始化随机数生成器
     srand((unsigned int)time(NULL));
@@ -56,7 +59,7 @@ int main() {
     const int TEST_ROUNDS = 10;  // 从原来的3轮增加到10轮
     
     // 创建结果表格
-    cout << "数据量\t密码长度\t串行(秒)\t2路SSE2(秒)\t4路SSE(秒)\t8路AVX2(秒)\t2路加速\t4路加速\t8路加速" << endl;
+    cout << "数据量\t密码长度\t串行(秒)\t2路SSE2(秒)\t4路SSE(秒)\t8路AVX2(秒)\t混合(秒)\t2路加速\t4路加速\t8路加速\t混合加速" << endl;
     
     // 对每种数据规模和密码长度组合进行测试
     for (int i = 0; i < DATA_SIZES_COUNT; i++) {
@@ -77,6 +80,7 @@ int main() {
             double total_sse2_time = 0;
             double total_sse4_time = 0;
             double total_avx2_time = 0;
+            double total_hybrid_time = 0;
             
             for (int round = 0; round < actual_rounds; round++) {
                 cout << "测试: " << dataSize << "个密码 x " << pwLength 
@@ -186,6 +190,18 @@ int main() {
                 double time_avx2 = double(duration_avx2) / 1000000.0;
                 total_avx2_time += time_avx2;
                 
+                // 5. 测试自动调优选出的实现（可能是向量+标量的混合内核）
+                bit32* hybrid_results = new bit32[dataSize * 4];
+                auto start_hybrid = high_resolution_clock::now();
+                
+                md5_batch(pw_array, dataSize, hybrid_results, tuned);
+                
+                auto end_hybrid = high_resolution_clock::now();
+                auto duration_hybrid = duration_cast<microseconds>(end_hybrid - start_hybrid).count();
+                double time_hybrid = double(duration_hybrid) / 1000000.0;
+                total_hybrid_time += time_hybrid;
+                delete[] hybrid_results;
+                
                 cout << "完成" << endl;
                 
                 // 释放内存
@@ -204,11 +220,13 @@ int main() {
             double avg_sse2 = total_sse2_time / actual_rounds;
             double avg_sse4 = total_sse4_time / actual_rounds;
             double avg_avx2 = total_avx2_time / actual_rounds;
+            double avg_hybrid = total_hybrid_time / actual_rounds;
             
             // 计算加速比
             double speedup_sse2 = avg_serial / avg_sse2;
             double speedup_sse4 = avg_serial / avg_sse4;
             double speedup_avx2 = avg_serial / avg_avx2;
+            double speedup_hybrid = avg_serial / avg_hybrid;
             
             // 打印结果行到控制台
             cout << dataSize << "\t" << pwLength << "\t\t" 
@@ -216,9 +234,11 @@ int main() {
                  << avg_sse2 << "\t" 
                  << avg_sse4 << "\t" 
                  << avg_avx2 << "\t" 
+                 << avg_hybrid << "\t" 
                  << setprecision(2) << speedup_sse2 << "x\t" 
                  << speedup_sse4 << "x\t" 
-                 << speedup_avx2 << "x" << endl;
+                 << speedup_avx2 << "x\t" 
+                 << speedup_hybrid << "x" << endl;
             
             // 写入结果到CSV文件
             csvFile << dataSize << "," << pwLength << "," 
@@ -226,9 +246,11 @@ int main() {
                     << avg_sse2 << "," 
                     << avg_sse4 << "," 
                     << avg_avx2 << "," 
+                    << avg_hybrid << "," 
                     << setprecision(2) << speedup_sse2 << "," 
                     << speedup_sse4 << "," 
-                    << speedup_avx2 << endl;
+                    << speedup_avx2 << "," 
+                    << speedup_hybrid << endl;
         }
     }
     
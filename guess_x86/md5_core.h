@@ -0,0 +1,1167 @@
+#ifndef MD5_CORE_H
+#define MD5_CORE_H
+
+// 与宽度无关的MD5压缩核心
+// 标量、NEON、SSE2、AVX2共用同一份64步调度：每种指令集只需要提供一个向量特征类（traits），
+// 说明向量类型、通道数、加法、循环左移、F/G/H/I四个轮函数以及消息的装载/结果的写回方式，
+// 交错的向量个数N作为模板参数，由编译器把64步在N个向量上完全展开。
+//
+// 注意：整个文件放在匿名命名空间中。不同的.cpp可能以不同的指令集选项编译（例如md5_avx2.cpp在
+// #pragma GCC target("avx2")的范围内引入本文件），如果这里的模板具有外部链接，链接器可能会把用AVX2编译出的
+// 标量实例交给不支持AVX2的代码路径使用。
+// 用pragma启用AVX2时编译器不会定义__AVX2__，由引入者定义MD5_CORE_AVX2来启用Avx2Ops。
+
+#include "md5.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__) || defined(MD5_CORE_AVX2)
+#include <immintrin.h>
+#endif
+
+#define MD5_INLINE inline __attribute__((always_inline))
+
+namespace {
+
+// ==================== 编译期生成的调度 ====================
+
+// 第i步使用的消息字下标：四轮分别为 i、(5i+1)%16、(3i+5)%16、7i%16
+constexpr int MD5MessageIndex(int i)
+{
+    return i < 16 ? i : i < 32 ? (5 * i + 1) % 16 : i < 48 ? (3 * i + 5) % 16 : (7 * i) % 16;
+}
+
+// 第i步的循环左移量：每一轮4个移位量循环使用
+constexpr int MD5Shift(int i)
+{
+    constexpr int shifts[4][4] = {{s11, s12, s13, s14}, {s21, s22, s23, s24}, {s31, s32, s33, s34}, {s41, s42, s43, s44}};
+    return shifts[i / 16][i % 4];
+}
+
+// 第i步的加法常数，K[i] = floor(2^32 * |sin(i+1)|)
+constexpr bit32 MD5K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+    0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+    0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+    0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+    0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+    0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+// 第i步更新的寄存器在(a, b, c, d)中的下标：依次为a、d、c、b
+constexpr int MD5Target(int i)
+{
+    return (64 - i) % 4;
+}
+
+constexpr bit32 MD5InitState[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+// ==================== 目标集合的分块Bloom过滤器 ====================
+// 每块8个bit32（256位，恰好一个AVX2寄存器或两个NEON/SSE寄存器），以状态字a为键：
+// 键的高位选出一块，块内第i个字由 (key * salt[i]) >> 27 选出1位，8位全部为1才可能命中。
+// 查询只访问一个缓存行，SIMD版本可以一次检查整块，或者用gather一次检查多个通道。
+constexpr bit32 MD5FilterSalt[8] = {0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+                                    0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31};
+
+// 键所在的块：把32位的键按比例映射到[0, blocks)，不要求块数是2的幂
+MD5_INLINE size_t MD5FilterBlock(bit32 key, bit32 blocks)
+{
+    return (uint64_t)key * blocks >> 32;
+}
+
+MD5_INLINE void MD5FilterInsert(bit32 *filter, bit32 blocks, bit32 key)
+{
+    bit32 *block = filter + 8 * MD5FilterBlock(key, blocks);
+    for (int i = 0; i < 8; i++)
+    {
+        block[i] |= 1u << (key * MD5FilterSalt[i] >> 27);
+    }
+}
+
+MD5_INLINE bool MD5FilterContains(const bit32 *filter, bit32 blocks, bit32 key)
+{
+    const bit32 *block = filter + 8 * MD5FilterBlock(key, blocks);
+    bit32 miss = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        miss |= ~block[i] & (1u << (key * MD5FilterSalt[i] >> 27));
+    }
+    return miss == 0;
+}
+
+// ==================== 各指令集的向量特征类 ====================
+// 每个特征类需要提供：
+//   vec / lanes                  向量类型与通道数
+//   set1 / add / sub / select    广播、加法、减法、按掩码选择
+//   rotl<s> / rotr<s>            循环左移/右移s位
+//   round<R>(x, y, z)            第R轮的轮函数（0:F 1:G 2:H 3:I）
+//   load_block(blocks, x)        把lanes个64字节块转置装载为16个按字排列的向量
+//   load_words(p) / store_words  装载/写回lanes个连续的bit32（用于掩码、取出某个状态字等）
+//   cmpeq / movemask             逐通道比较相等，并把比较结果压缩为每通道1位的整数（破解模式使用）
+//   probe_filter(keys, f, n)     用每个通道的键查询分块Bloom过滤器，返回可能命中的通道位掩码
+//   store_digests(st, out)       字节序调整后把(a,b,c,d)转置写回为lanes个连续的摘要
+
+// 标量：1个通道，直接使用md5.h中的F/G/H/I宏
+struct ScalarOps
+{
+    typedef bit32 vec;
+    static const int lanes = 1;
+
+    static MD5_INLINE vec set1(bit32 v) { return v; }
+    static MD5_INLINE vec add(vec a, vec b) { return a + b; }
+    static MD5_INLINE vec sub(vec a, vec b) { return a - b; }
+    static MD5_INLINE vec select(vec mask, vec a, vec b) { return (mask & a) | (~mask & b); }
+    static MD5_INLINE vec cmpeq(vec a, vec b) { return a == b ? 0xffffffff : 0; }
+    static MD5_INLINE int movemask(vec m) { return m & 1; }
+    template <int s> static MD5_INLINE vec rotl(vec x) { return ROTATELEFT(x, s); }
+    template <int s> static MD5_INLINE vec rotr(vec x) { return ROTATELEFT(x, 32 - s); }
+
+    template <int R>
+    static MD5_INLINE vec round(vec x, vec y, vec z)
+    {
+        if constexpr (R == 0) return F(x, y, z);
+        else if constexpr (R == 1) return G(x, y, z);
+        else if constexpr (R == 2) return H(x, y, z);
+        else return I(x, y, z);
+    }
+
+    static MD5_INLINE void load_block(const Byte *const *blocks, vec (&x)[16])
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            const Byte *p = blocks[0] + 4 * j;
+            x[j] = p[0] | (p[1] << 8) | (p[2] << 16) | ((bit32)p[3] << 24);
+        }
+    }
+
+    static MD5_INLINE vec load_words(const bit32 *p) { return p[0]; }
+    static MD5_INLINE void store_words(vec v, bit32 *p) { p[0] = v; }
+    static MD5_INLINE int probe_filter(vec key, const bit32 *filter, bit32 blocks)
+    {
+        return MD5FilterContains(filter, blocks, key);
+    }
+
+    static MD5_INLINE void store_digests(const vec (&st)[4], bit32 *out)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            out[r] = __builtin_bswap32(st[r]);
+        }
+    }
+};
+
+#if defined(__ARM_NEON)
+// 字节交换宏，用于最终结果处理
+#define ByteSwapSIMD(value) \
+    vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(value)))
+
+// 4x4 32位转置宏：输入r0..r3为4条消息各自连续的4个字，输出r0..r3为同一字下标在4条消息上的值
+// 即把按消息排列的数据（AoS）转换为按字排列的数据（SoA），以替代逐通道的标量收集
+#define TRANSPOSE4_SIMD(r0, r1, r2, r3) { \
+    uint32x4x2_t t01 = vtrnq_u32((r0), (r1)); \
+    uint32x4x2_t t23 = vtrnq_u32((r2), (r3)); \
+    (r0) = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0])); \
+    (r1) = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1])); \
+    (r2) = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0])); \
+    (r3) = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1])); \
+}
+
+// NEON：4个通道
+struct NeonOps
+{
+    typedef uint32x4_t vec;
+    static const int lanes = 4;
+
+    static MD5_INLINE vec set1(bit32 v) { return vdupq_n_u32(v); }
+    static MD5_INLINE vec add(vec a, vec b) { return vaddq_u32(a, b); }
+    static MD5_INLINE vec sub(vec a, vec b) { return vsubq_u32(a, b); }
+    static MD5_INLINE vec select(vec mask, vec a, vec b) { return vbslq_u32(mask, a, b); }
+    static MD5_INLINE vec cmpeq(vec a, vec b) { return vceqq_u32(a, b); }
+    static MD5_INLINE int movemask(vec m)
+    {
+        static const bit32 bits[4] = {1, 2, 4, 8};
+        return vaddvq_u32(vandq_u32(m, vld1q_u32(bits)));
+    }
+    // 左移后用SRI把高位插入低位，两条指令完成循环移位
+    template <int s> static MD5_INLINE vec rotl(vec x) { return vsriq_n_u32(vshlq_n_u32(x, s), x, 32 - s); }
+    template <int s> static MD5_INLINE vec rotr(vec x) { return vsriq_n_u32(vshlq_n_u32(x, 32 - s), x, s); }
+
+    template <int R>
+    static MD5_INLINE vec round(vec x, vec y, vec z)
+    {
+        // F和G恰好是按位选择，可以用一条BSL完成；I中的 x | ~z 用ORN完成
+        if constexpr (R == 0) return vbslq_u32(x, y, z);
+        else if constexpr (R == 1) return vbslq_u32(z, x, y);
+        else if constexpr (R == 2) return veorq_u32(veorq_u32(x, y), z);
+        else return veorq_u32(y, vornq_u32(x, z));
+    }
+
+    static MD5_INLINE void load_block(const Byte *const *blocks, vec (&x)[16])
+    {
+        for (int j = 0; j < 16; j += 4)
+        {
+            x[j] = vld1q_u32((const uint32_t *)(blocks[0] + 4 * j));
+            x[j + 1] = vld1q_u32((const uint32_t *)(blocks[1] + 4 * j));
+            x[j + 2] = vld1q_u32((const uint32_t *)(blocks[2] + 4 * j));
+            x[j + 3] = vld1q_u32((const uint32_t *)(blocks[3] + 4 * j));
+            TRANSPOSE4_SIMD(x[j], x[j + 1], x[j + 2], x[j + 3]);
+        }
+    }
+
+    static MD5_INLINE vec load_words(const bit32 *p) { return vld1q_u32(p); }
+    static MD5_INLINE void store_words(vec v, bit32 *p) { vst1q_u32(p, v); }
+
+    // 逐个通道查询，每个键用两个128位寄存器一次检查整块的8个字
+    static MD5_INLINE int probe_filter(vec keys, const bit32 *filter, bit32 blocks)
+    {
+        alignas(16) bit32 k[4];
+        vst1q_u32(k, keys);
+        const vec salt_lo = vld1q_u32(MD5FilterSalt), salt_hi = vld1q_u32(MD5FilterSalt + 4);
+        const vec one = vdupq_n_u32(1);
+        int mask = 0;
+        for (int l = 0; l < 4; l++)
+        {
+            const bit32 *block = filter + 8 * MD5FilterBlock(k[l], blocks);
+            vec h = vdupq_n_u32(k[l]);
+            vec bit_lo = vshlq_u32(one, vreinterpretq_s32_u32(vshrq_n_u32(vmulq_u32(h, salt_lo), 27)));
+            vec bit_hi = vshlq_u32(one, vreinterpretq_s32_u32(vshrq_n_u32(vmulq_u32(h, salt_hi), 27)));
+            vec hit = vandq_u32(vtstq_u32(vld1q_u32(block), bit_lo), vtstq_u32(vld1q_u32(block + 4), bit_hi));
+            mask |= (vminvq_u32(hit) != 0) << l;
+        }
+        return mask;
+    }
+
+    static MD5_INLINE void store_digests(const vec (&st)[4], bit32 *out)
+    {
+        vec r0 = ByteSwapSIMD(st[0]), r1 = ByteSwapSIMD(st[1]), r2 = ByteSwapSIMD(st[2]), r3 = ByteSwapSIMD(st[3]);
+        TRANSPOSE4_SIMD(r0, r1, r2, r3);
+        vst1q_u32(out, r0);
+        vst1q_u32(out + 4, r1);
+        vst1q_u32(out + 8, r2);
+        vst1q_u32(out + 12, r3);
+    }
+};
+#endif
+
+#if defined(__SSE2__)
+// SSE 版本的4x4 32位转置：输入r0..r3为4条消息各自连续的4个字，输出r0..r3为同一字下标在4条消息上的值
+// 用unpack lo/hi完成AoS到SoA的转换，替代逐字节拼接和_mm_set_epi32
+#define TRANSPOSE4_SSE(r0, r1, r2, r3) { \
+    __m128i t0 = _mm_unpacklo_epi32((r0), (r1)); \
+    __m128i t1 = _mm_unpacklo_epi32((r2), (r3)); \
+    __m128i t2 = _mm_unpackhi_epi32((r0), (r1)); \
+    __m128i t3 = _mm_unpackhi_epi32((r2), (r3)); \
+    (r0) = _mm_unpacklo_epi64(t0, t1); \
+    (r1) = _mm_unpackhi_epi64(t0, t1); \
+    (r2) = _mm_unpacklo_epi64(t2, t3); \
+    (r3) = _mm_unpackhi_epi64(t2, t3); \
+}
+
+// SSE2：4个通道
+struct SseOps
+{
+    typedef __m128i vec;
+    static const int lanes = 4;
+
+    static MD5_INLINE vec set1(bit32 v) { return _mm_set1_epi32(v); }
+    static MD5_INLINE vec add(vec a, vec b) { return _mm_add_epi32(a, b); }
+    static MD5_INLINE vec sub(vec a, vec b) { return _mm_sub_epi32(a, b); }
+    static MD5_INLINE vec select(vec mask, vec a, vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+    static MD5_INLINE vec cmpeq(vec a, vec b) { return _mm_cmpeq_epi32(a, b); }
+    static MD5_INLINE int movemask(vec m) { return _mm_movemask_ps(_mm_castsi128_ps(m)); }
+    template <int s> static MD5_INLINE vec rotl(vec x) { return _mm_or_si128(_mm_slli_epi32(x, s), _mm_srli_epi32(x, 32 - s)); }
+    template <int s> static MD5_INLINE vec rotr(vec x) { return _mm_or_si128(_mm_srli_epi32(x, s), _mm_slli_epi32(x, 32 - s)); }
+
+    template <int R>
+    static MD5_INLINE vec round(vec x, vec y, vec z)
+    {
+        // F = ((y ^ z) & x) ^ z，G = ((x ^ y) & z) ^ y，各少一次取反
+        if constexpr (R == 0) return _mm_xor_si128(_mm_and_si128(_mm_xor_si128(y, z), x), z);
+        else if constexpr (R == 1) return _mm_xor_si128(_mm_and_si128(_mm_xor_si128(x, y), z), y);
+        else if constexpr (R == 2) return _mm_xor_si128(_mm_xor_si128(x, y), z);
+        else return _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1))));
+    }
+
+    static MD5_INLINE void load_block(const Byte *const *blocks, vec (&x)[16])
+    {
+        for (int j = 0; j < 16; j += 4)
+        {
+            x[j] = _mm_loadu_si128((const __m128i *)(blocks[0] + 4 * j));
+            x[j + 1] = _mm_loadu_si128((const __m128i *)(blocks[1] + 4 * j));
+            x[j + 2] = _mm_loadu_si128((const __m128i *)(blocks[2] + 4 * j));
+            x[j + 3] = _mm_loadu_si128((const __m128i *)(blocks[3] + 4 * j));
+            TRANSPOSE4_SSE(x[j], x[j + 1], x[j + 2], x[j + 3]);
+        }
+    }
+
+    static MD5_INLINE vec load_words(const bit32 *p) { return _mm_loadu_si128((const __m128i *)p); }
+    static MD5_INLINE void store_words(vec v, bit32 *p) { _mm_storeu_si128((__m128i *)p, v); }
+
+    // SSE2没有32位乘法的低位结果和按通道移位，逐个通道使用标量查询
+    static MD5_INLINE int probe_filter(vec keys, const bit32 *filter, bit32 blocks)
+    {
+        alignas(16) bit32 k[4];
+        _mm_store_si128((__m128i *)k, keys);
+        int mask = 0;
+        for (int l = 0; l < 4; l++)
+        {
+            mask |= MD5FilterContains(filter, blocks, k[l]) << l;
+        }
+        return mask;
+    }
+
+    static MD5_INLINE vec bswap(vec v)
+    {
+#if defined(__SSSE3__)
+        return _mm_shuffle_epi8(v, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+#else
+        vec t = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        return _mm_or_si128(_mm_slli_epi32(t, 16), _mm_srli_epi32(t, 16));
+#endif
+    }
+
+    static MD5_INLINE void store_digests(const vec (&st)[4], bit32 *out)
+    {
+        vec r0 = bswap(st[0]), r1 = bswap(st[1]), r2 = bswap(st[2]), r3 = bswap(st[3]);
+        TRANSPOSE4_SSE(r0, r1, r2, r3);
+        _mm_storeu_si128((__m128i *)out, r0);
+        _mm_storeu_si128((__m128i *)(out + 4), r1);
+        _mm_storeu_si128((__m128i *)(out + 8), r2);
+        _mm_storeu_si128((__m128i *)(out + 12), r3);
+    }
+};
+#endif
+
+#if defined(__AVX2__) || defined(MD5_CORE_AVX2)
+// AVX2版本的8x8 32位转置：输入r0..r7为8条消息各自连续的8个字，输出r0..r7为同一字下标在8条消息上的值
+// 先在128位半区内用unpack lo/hi完成4x4转置，再用permute2x128交换两个半区
+#define TRANSPOSE8_AVX2(r0, r1, r2, r3, r4, r5, r6, r7) { \
+    __m256i t0 = _mm256_unpacklo_epi32((r0), (r1)); \
+    __m256i t1 = _mm256_unpackhi_epi32((r0), (r1)); \
+    __m256i t2 = _mm256_unpacklo_epi32((r2), (r3)); \
+    __m256i t3 = _mm256_unpackhi_epi32((r2), (r3)); \
+    __m256i t4 = _mm256_unpacklo_epi32((r4), (r5)); \
+    __m256i t5 = _mm256_unpackhi_epi32((r4), (r5)); \
+    __m256i t6 = _mm256_unpacklo_epi32((r6), (r7)); \
+    __m256i t7 = _mm256_unpackhi_epi32((r6), (r7)); \
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2); \
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2); \
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3); \
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3); \
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6); \
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6); \
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7); \
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7); \
+    (r0) = _mm256_permute2x128_si256(u0, u4, 0x20); \
+    (r1) = _mm256_permute2x128_si256(u1, u5, 0x20); \
+    (r2) = _mm256_permute2x128_si256(u2, u6, 0x20); \
+    (r3) = _mm256_permute2x128_si256(u3, u7, 0x20); \
+    (r4) = _mm256_permute2x128_si256(u0, u4, 0x31); \
+    (r5) = _mm256_permute2x128_si256(u1, u5, 0x31); \
+    (r6) = _mm256_permute2x128_si256(u2, u6, 0x31); \
+    (r7) = _mm256_permute2x128_si256(u3, u7, 0x31); \
+    }
+
+// AVX2：8个通道
+struct Avx2Ops
+{
+    typedef __m256i vec;
+    static const int lanes = 8;
+
+    static MD5_INLINE vec set1(bit32 v) { return _mm256_set1_epi32(v); }
+    static MD5_INLINE vec add(vec a, vec b) { return _mm256_add_epi32(a, b); }
+    static MD5_INLINE vec sub(vec a, vec b) { return _mm256_sub_epi32(a, b); }
+    static MD5_INLINE vec select(vec mask, vec a, vec b) { return _mm256_blendv_epi8(b, a, mask); }
+    static MD5_INLINE vec cmpeq(vec a, vec b) { return _mm256_cmpeq_epi32(a, b); }
+    static MD5_INLINE int movemask(vec m) { return _mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+    template <int s> static MD5_INLINE vec rotl(vec x) { return _mm256_or_si256(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - s)); }
+    template <int s> static MD5_INLINE vec rotr(vec x) { return _mm256_or_si256(_mm256_srli_epi32(x, s), _mm256_slli_epi32(x, 32 - s)); }
+
+    template <int R>
+    static MD5_INLINE vec round(vec x, vec y, vec z)
+    {
+        if constexpr (R == 0) return _mm256_xor_si256(_mm256_and_si256(_mm256_xor_si256(y, z), x), z);
+        else if constexpr (R == 1) return _mm256_xor_si256(_mm256_and_si256(_mm256_xor_si256(x, y), z), y);
+        else if constexpr (R == 2) return _mm256_xor_si256(_mm256_xor_si256(x, y), z);
+        else return _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1))));
+    }
+
+    static MD5_INLINE void load_block(const Byte *const *blocks, vec (&x)[16])
+    {
+        for (int j = 0; j < 16; j += 8)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                x[j + k] = _mm256_loadu_si256((const __m256i *)(blocks[k] + 4 * j));
+            }
+            TRANSPOSE8_AVX2(x[j], x[j + 1], x[j + 2], x[j + 3], x[j + 4], x[j + 5], x[j + 6], x[j + 7]);
+        }
+    }
+
+    static MD5_INLINE vec load_words(const bit32 *p) { return _mm256_loadu_si256((const __m256i *)p); }
+    static MD5_INLINE void store_words(vec v, bit32 *p) { _mm256_storeu_si256((__m256i *)p, v); }
+
+    // 8个通道同时查询：先算出每个通道所在的块，再对块内的8个字各做一次gather
+    static MD5_INLINE int probe_filter(vec keys, const bit32 *filter, bit32 blocks)
+    {
+        // 块号 = (key * blocks) >> 32，偶数/奇数通道分别用32x32->64位乘法得到高32位
+        const vec n = _mm256_set1_epi32(blocks);
+        vec even = _mm256_srli_epi64(_mm256_mul_epu32(keys, n), 32);
+        vec odd = _mm256_mul_epu32(_mm256_srli_epi64(keys, 32), n);
+        vec base = _mm256_slli_epi32(_mm256_blend_epi32(even, odd, 0xaa), 3);
+        const vec one = _mm256_set1_epi32(1);
+        vec hit = _mm256_set1_epi32(-1);
+        for (int i = 0; i < 8; i++)
+        {
+            vec word = _mm256_i32gather_epi32((const int *)filter, _mm256_add_epi32(base, _mm256_set1_epi32(i)), 4);
+            vec bit = _mm256_sllv_epi32(one, _mm256_srli_epi32(_mm256_mullo_epi32(keys, _mm256_set1_epi32(MD5FilterSalt[i])), 27));
+            hit = _mm256_and_si256(hit, _mm256_cmpeq_epi32(_mm256_and_si256(word, bit), bit));
+        }
+        return movemask(hit);
+    }
+
+    static MD5_INLINE void store_digests(const vec (&st)[4], bit32 *out)
+    {
+        const vec swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                         12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        vec a = _mm256_shuffle_epi8(st[0], swap), b = _mm256_shuffle_epi8(st[1], swap);
+        vec c = _mm256_shuffle_epi8(st[2], swap), d = _mm256_shuffle_epi8(st[3], swap);
+        // 半区内4x4转置得到通道(0,4)(1,5)(2,6)(3,7)的摘要，再交换半区
+        vec t0 = _mm256_unpacklo_epi32(a, b), t1 = _mm256_unpacklo_epi32(c, d);
+        vec t2 = _mm256_unpackhi_epi32(a, b), t3 = _mm256_unpackhi_epi32(c, d);
+        vec u0 = _mm256_unpacklo_epi64(t0, t1), u1 = _mm256_unpackhi_epi64(t0, t1);
+        vec u2 = _mm256_unpacklo_epi64(t2, t3), u3 = _mm256_unpackhi_epi64(t2, t3);
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(u0, u1, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 8), _mm256_permute2x128_si256(u2, u3, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 16), _mm256_permute2x128_si256(u0, u1, 0x31));
+        _mm256_storeu_si256((__m256i *)(out + 24), _mm256_permute2x128_si256(u2, u3, 0x31));
+    }
+};
+#endif
+
+// ==================== 压缩函数 ====================
+
+// 第i步：对N个交错的向量依次执行，N个向量之间没有数据依赖
+// 先计算 a + x[k] + K（与上一步结果无关，可以提前执行），再加上依赖b/c/d的轮函数
+template <class V, int N, int i>
+MD5_INLINE void MD5Step(typename V::vec (&st)[4][N], const typename V::vec (&x)[N][16])
+{
+    constexpr int ta = MD5Target(i);
+    constexpr int tb = (ta + 1) % 4, tc = (ta + 2) % 4, td = (ta + 3) % 4;
+    for (int v = 0; v < N; v++)
+    {
+        typename V::vec t = V::add(st[ta][v], V::add(x[v][MD5MessageIndex(i)], V::set1(MD5K[i])));
+        t = V::add(t, V::template round<i / 16>(st[tb][v], st[tc][v], st[td][v]));
+        st[ta][v] = V::add(st[tb][v], V::template rotl<MD5Shift(i)>(t));
+    }
+}
+
+template <class V, int N, int Begin, int... Is>
+MD5_INLINE void MD5StepsImpl(typename V::vec (&st)[4][N], const typename V::vec (&x)[N][16], std::integer_sequence<int, Is...>)
+{
+    (MD5Step<V, N, Begin + Is>(st, x), ...);
+}
+
+// 执行第[Begin, End)步，在编译期完全展开
+template <class V, int N, int Begin = 0, int End = 64>
+MD5_INLINE void MD5Steps(typename V::vec (&st)[4][N], const typename V::vec (&x)[N][16])
+{
+    MD5StepsImpl<V, N, Begin>(st, x, std::make_integer_sequence<int, End - Begin>());
+}
+
+// 标量第i步：直接使用md5.h中的FF/GG/HH/II宏，供混合内核与向量步交错发射
+template <int S, int i>
+MD5_INLINE void MD5ScalarStep(bit32 (&st)[4][S], const bit32 (&x)[S][16])
+{
+    constexpr int ta = MD5Target(i);
+    constexpr int tb = (ta + 1) % 4, tc = (ta + 2) % 4, td = (ta + 3) % 4;
+    constexpr int k = MD5MessageIndex(i), s = MD5Shift(i);
+    constexpr bit32 ac = MD5K[i];
+    for (int v = 0; v < S; v++)
+    {
+        bit32 &a = st[ta][v], b = st[tb][v], c = st[tc][v], d = st[td][v];
+        if constexpr (i < 16) FF(a, b, c, d, x[v][k], s, ac)
+        else if constexpr (i < 32) GG(a, b, c, d, x[v][k], s, ac)
+        else if constexpr (i < 48) HH(a, b, c, d, x[v][k], s, ac)
+        else II(a, b, c, d, x[v][k], s, ac)
+    }
+}
+
+// 混合内核的第i步：向量单元和标量整数单元各执行一步，两者没有数据依赖，
+// 乱序核心可以在同一周期把它们发射到不同的执行端口
+template <class V, int N, int S, int... Is>
+MD5_INLINE void MD5HybridStepsImpl(typename V::vec (&st)[4][N], const typename V::vec (&x)[N][16],
+                                   bit32 (&sst)[4][S], const bit32 (&sx)[S][16], std::integer_sequence<int, Is...>)
+{
+    ((MD5Step<V, N, Is>(st, x), MD5ScalarStep<S, Is>(sst, sx)), ...);
+}
+
+/**
+ * MD5CompressLanes: 用N个交错的V向量同时计算至多V::lanes*N条消息的MD5
+ * S>0时再附带S条消息走标量FF/GG/HH/II路径，与向量步逐步交错（排在向量通道之后）
+ * 算完最后一块后，最终状态仍在寄存器中时交给finish.apply处理（写回摘要，或者在破解模式下直接与目标比较）
+ * @param paddedMessages 已经填充好的消息，长度为64字节的整数倍
+ * @param n_blocks 每条消息的块数，允许各不相同
+ * @param count 实际的消息数，不足V::lanes*N+S时空闲通道读取全零块
+ * @param first 这一批的第一条消息在整个输入中的下标，原样传给finish
+ * @param finish 结尾处理，需要提供 apply<V, N, S>(st, sst, first, count)
+ */
+template <class V, int N, int S, class Finish>
+void MD5CompressLanes(const Byte *const *paddedMessages, const int *n_blocks, int count, size_t first, Finish &finish)
+{
+    typedef typename V::vec vec;
+    const int vlanes = V::lanes * N;
+    const int lanes = vlanes + S;
+    // 标量通道的数组至少保留1个元素，S为0时不参与计算
+    constexpr int SS = S > 0 ? S : 1;
+    alignas(64) static const Byte zero_block[64] = {0};
+
+    int max_blocks = 0, min_blocks = count > 0 ? n_blocks[0] : 0;
+    for (int i = 0; i < count; i++)
+    {
+        max_blocks = n_blocks[i] > max_blocks ? n_blocks[i] : max_blocks;
+        min_blocks = n_blocks[i] < min_blocks ? n_blocks[i] : min_blocks;
+    }
+
+    vec st[4][N];
+    bit32 sst[4][SS];
+    for (int r = 0; r < 4; r++)
+    {
+        for (int v = 0; v < N; v++)
+        {
+            st[r][v] = V::set1(MD5InitState[r]);
+        }
+        for (int v = 0; v < SS; v++)
+        {
+            sst[r][v] = MD5InitState[r];
+        }
+    }
+
+    for (int block = 0; block < max_blocks; block++)
+    {
+        const Byte *blocks[lanes];
+        alignas(64) bit32 live[lanes];
+        for (int i = 0; i < lanes; i++)
+        {
+            bool active = i < count && block < n_blocks[i];
+            blocks[i] = active ? paddedMessages[i] + block * 64 : zero_block;
+            live[i] = active ? 0xffffffff : 0;
+        }
+
+        vec x[N][16];
+        for (int v = 0; v < N; v++)
+        {
+            V::load_block(blocks + V::lanes * v, x[v]);
+        }
+
+        vec s[4][N];
+        bit32 ss[4][SS];
+        for (int r = 0; r < 4; r++)
+        {
+            for (int v = 0; v < N; v++)
+            {
+                s[r][v] = st[r][v];
+            }
+            for (int v = 0; v < SS; v++)
+            {
+                ss[r][v] = sst[r][v];
+            }
+        }
+
+        if constexpr (S > 0)
+        {
+            bit32 sx[S][16];
+            for (int v = 0; v < S; v++)
+            {
+                ScalarOps::load_block(blocks + vlanes + v, sx[v]);
+            }
+            MD5HybridStepsImpl<V, N, S>(s, x, ss, sx, std::make_integer_sequence<int, 64>());
+        }
+        else
+        {
+            MD5Steps<V, N>(s, x);
+        }
+
+        // 所有消息都还有块可处理时直接累加；否则已经结束的通道保持原状态
+        for (int v = 0; v < N; v++)
+        {
+            vec mask = V::load_words(live + V::lanes * v);
+            for (int r = 0; r < 4; r++)
+            {
+                vec sum = V::add(st[r][v], s[r][v]);
+                st[r][v] = block < min_blocks ? sum : V::select(mask, sum, st[r][v]);
+            }
+        }
+        for (int v = 0; v < S; v++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                sst[r][v] = live[vlanes + v] ? sst[r][v] + ss[r][v] : sst[r][v];
+            }
+        }
+    }
+
+    finish.template apply<V, N, S>(st, sst, first, count);
+}
+
+// 结尾处理：字节序调整后把摘要写回连续数组，第i条消息的结果位于digests[4*i..4*i+3]
+struct MD5StoreDigests
+{
+    bit32 *digests;
+
+    template <class V, int N, int S, int SS>
+    MD5_INLINE void apply(typename V::vec (&st)[4][N], bit32 (&sst)[4][SS], size_t first, int count)
+    {
+        const int vlanes = V::lanes * N;
+        alignas(64) bit32 out[(vlanes + S) * 4];
+        for (int v = 0; v < N; v++)
+        {
+            typename V::vec group[4] = {st[0][v], st[1][v], st[2][v], st[3][v]};
+            V::store_digests(group, out + V::lanes * v * 4);
+        }
+        for (int v = 0; v < S; v++)
+        {
+            bit32 group[4] = {sst[0][v], sst[1][v], sst[2][v], sst[3][v]};
+            ScalarOps::store_digests(group, out + (vlanes + v) * 4);
+        }
+        memcpy(digests + 4 * first, out, sizeof(bit32) * 4 * count);
+    }
+};
+
+/**
+ * MD5HashLanes: 计算至多V::lanes*N+S条消息的MD5，结果写入连续的摘要数组
+ * @param[out] digests 第i条消息的结果位于digests[4*i..4*i+3]
+ */
+template <class V, int N, int S = 0>
+void MD5HashLanes(const Byte *const *paddedMessages, const int *n_blocks, int count, bit32 *digests)
+{
+    MD5StoreDigests finish = {digests};
+    MD5CompressLanes<V, N, S>(paddedMessages, n_blocks, count, 0, finish);
+}
+
+template <class V, int S, class Finish>
+MD5_INLINE void MD5CompressLanesWays(int groups, const Byte *const *paddedMessages, const int *n_blocks, int count,
+                                     size_t first, Finish &finish)
+{
+    if (groups == 3)
+        MD5CompressLanes<V, 3, S>(paddedMessages, n_blocks, count, first, finish);
+    else if (groups == 2)
+        MD5CompressLanes<V, 2, S>(paddedMessages, n_blocks, count, first, finish);
+    else
+        MD5CompressLanes<V, 1, S>(paddedMessages, n_blocks, count, first, finish);
+}
+
+/**
+ * MD5CompressMessages: 把任意条已填充的消息按每批V::lanes*ways(+scalar_lanes)条交给MD5CompressLanes
+ * 剩余不足一整批的部分自动降为更少的交错路数（不再附带标量通道），最后一批允许有空闲通道
+ * @param ways 交错的向量个数（1/2/3）
+ * @param scalar_lanes 与向量一起交错计算的标量消息数（0/1/2），利用空闲的标量整数端口
+ * @param first 第一条消息在整个输入中的下标
+ */
+template <class V, class Finish>
+void MD5CompressMessages(const Byte *const *paddedMessages, const int *n_blocks, size_t count, int ways,
+                         int scalar_lanes, size_t first, Finish &finish)
+{
+    size_t done = 0;
+    int groups = ways < 1 ? 1 : ways > 3 ? 3 : ways;
+    int extra = scalar_lanes < 0 ? 0 : scalar_lanes > 2 ? 2 : scalar_lanes;
+
+    // 混合批次：V::lanes*groups条消息走向量，extra条消息走标量
+    const size_t hybrid = V::lanes * groups + extra;
+    while (extra > 0 && count - done >= hybrid)
+    {
+        if (extra == 2)
+            MD5CompressLanesWays<V, 2>(groups, paddedMessages + done, n_blocks + done, hybrid, first + done, finish);
+        else
+            MD5CompressLanesWays<V, 1>(groups, paddedMessages + done, n_blocks + done, hybrid, first + done, finish);
+        done += hybrid;
+    }
+
+    while (done < count)
+    {
+        size_t remain = count - done;
+        while (groups > 1 && remain < (size_t)(V::lanes * groups))
+        {
+            groups -= 1;
+        }
+        int n = (int)(remain < (size_t)(V::lanes * groups) ? remain : V::lanes * groups);
+        MD5CompressLanesWays<V, 0>(groups, paddedMessages + done, n_blocks + done, n, first + done, finish);
+        done += n;
+    }
+}
+
+/**
+ * MD5HashMessages: 计算任意条已填充消息的MD5，结果写入连续的摘要数组
+ * @param ways 交错的向量个数（1/2/3）
+ * @param scalar_lanes 与向量一起交错计算的标量消息数（0/1/2）
+ */
+template <class V>
+void MD5HashMessages(const Byte *const *paddedMessages, const int *n_blocks, size_t count, bit32 *digests, int ways,
+                     int scalar_lanes = 0)
+{
+    MD5StoreDigests finish = {digests};
+    MD5CompressMessages<V>(paddedMessages, n_blocks, count, ways, scalar_lanes, 0, finish);
+}
+
+// ==================== 批量接口的公共部分 ====================
+
+// 长度为length字节的消息填充后的字节数：至少追加1字节0x80和8字节长度，再补齐到64字节的整数倍
+MD5_INLINE size_t MD5PaddedLength(size_t length)
+{
+    return (length + 8) / 64 * 64 + 64;
+}
+
+/**
+ * MD5PadMessage: 把消息填充到调用者提供的缓冲区中，不做任何内存分配
+ * @param message 原始消息
+ * @param length 原始消息的字节数
+ * @param[out] out 至少MD5PaddedLength(length)字节的缓冲区
+ * @return 填充后的块数
+ */
+MD5_INLINE int MD5PadMessage(const Byte *message, size_t length, Byte *out)
+{
+    size_t paddedLength = MD5PaddedLength(length);
+    memcpy(out, message, length);
+    out[length] = 0x80;
+    memset(out + length + 1, 0, paddedLength - length - 9);
+    uint64_t bitLength = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++)
+    {
+        out[paddedLength - 8 + i] = (bitLength >> (i * 8)) & 0xFF;
+    }
+    return (int)(paddedLength / 64);
+}
+
+// 输入不少于这么多条时，md5_batch把各段分给OpenMP线程；更小的批次线程调度的开销不划算
+#define MD5_BATCH_PARALLEL_MIN 16384
+
+// 每段的消息数：口令一般只有1块，一段的填充数据约64KB、摘要16KB，每个线程的工作集能留在L2中
+#define MD5_BATCH_CHUNK 1024
+
+/**
+ * MD5ForEachChunk: 把连续的字符串数组按段填充到线程私有的工作区中（不逐条分配内存），再对每一段调用process
+ * 输入较多时各段由OpenMP线程并行处理：每个线程使用自己的工作区，process只应写入与这一段对应的输出
+ * @param inputs 输入字符串数组，不会被修改
+ * @param count 输入字符串的总数，可以是任意值
+ * @param process 以(paddedMessages, n_blocks, n, base)调用，base为这一段第一条消息的下标
+ */
+template <class Process>
+void MD5ForEachChunk(const string *inputs, size_t count, Process process)
+{
+    const size_t chunk = MD5_BATCH_CHUNK;
+    const size_t chunks = (count + chunk - 1) / chunk;
+
+#pragma omp parallel for schedule(dynamic, 4) if (count >= MD5_BATCH_PARALLEL_MIN)
+    for (size_t c = 0; c < chunks; c++)
+    {
+        static thread_local vector<Byte> arena;
+        const Byte *paddedMessages[chunk];
+        int n_blocks[chunk];
+        size_t offsets[chunk];
+
+        size_t base = c * chunk;
+        size_t n = count - base < chunk ? count - base : chunk;
+        size_t total = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            offsets[i] = total;
+            total += MD5PaddedLength(inputs[base + i].size());
+        }
+        if (arena.size() < total)
+        {
+            arena.resize(total);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            const string &input = inputs[base + i];
+            paddedMessages[i] = arena.data() + offsets[i];
+            n_blocks[i] = MD5PadMessage((const Byte *)input.data(), input.size(), arena.data() + offsets[i]);
+        }
+        process(paddedMessages, n_blocks, n, base);
+    }
+}
+
+/**
+ * MD5HashBatch: 对连续的字符串数组计算MD5，结果写入连续的摘要数组
+ * @param inputs 输入字符串数组
+ * @param count 输入字符串的总数
+ * @param[out] digests 连续的摘要数组，大小为count*4
+ * @param ways 交错的向量个数（1/2/3）
+ * @param scalar_lanes 与向量一起交错计算的标量消息数（0/1/2）
+ */
+template <class V>
+void MD5HashBatch(const string *inputs, size_t count, bit32 *digests, int ways, int scalar_lanes = 0)
+{
+    MD5ForEachChunk(inputs, count, [&](const Byte *const *paddedMessages, const int *n_blocks, size_t n, size_t base) {
+        MD5StoreDigests finish = {digests};
+        MD5CompressMessages<V>(paddedMessages, n_blocks, n, ways, scalar_lanes, base, finish);
+    });
+}
+
+// ==================== 破解模式 ====================
+
+// 目标不超过这么多条时，第一级比较直接把每个目标的第一个字广播后与状态逐个比较；否则查询分块Bloom过滤器
+#define MD5_CRACK_BROADCAST_MAX 8
+
+// 在按字典序排好的目标摘要中查找，用于第二级的完整比较
+MD5_INLINE bool MD5TargetContains(const MD5TargetSet &targets, const bit32 *digest)
+{
+    size_t lo = 0, hi = targets.digests.size() / 4;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const bit32 *d = targets.digests.data() + 4 * mid;
+        int r = 0;
+        while (r < 4 && d[r] == digest[r])
+        {
+            r++;
+        }
+        if (r == 4)
+            return true;
+        if (d[r] < digest[r])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+// 结尾处理：不写回摘要，只在最终状态上比较
+// 第一级：每个通道的状态字a（未做字节序调整）与目标的第一个字比较，得到候选通道的位掩码；
+// 第二级：只有候选通道才取出完整摘要，在排序的目标数组中确认，命中的记录到hits中
+struct MD5MatchTargets
+{
+    const MD5TargetSet *targets;
+    vector<MD5Hit> *hits;
+
+    // 对一组通道的状态字a做第一级比较，返回候选通道的位掩码
+    template <class V>
+    MD5_INLINE int candidates(typename V::vec a) const
+    {
+        if (targets->filter_blocks > 0)
+        {
+            return V::probe_filter(a, targets->filter.data(), targets->filter_blocks);
+        }
+        int mask = 0;
+        for (bit32 w : targets->first_words)
+        {
+            mask |= V::movemask(V::cmpeq(a, V::set1(w)));
+        }
+        return mask;
+    }
+
+    MD5_INLINE void verify(const bit32 *state, size_t index) const
+    {
+        MD5Hit hit;
+        hit.index = index;
+        for (int r = 0; r < 4; r++)
+        {
+            hit.digest[r] = __builtin_bswap32(state[r]);
+        }
+        if (MD5TargetContains(*targets, hit.digest))
+        {
+            hits->push_back(hit);
+        }
+    }
+
+    template <class V, int N, int S, int SS>
+    MD5_INLINE void apply(typename V::vec (&st)[4][N], bit32 (&sst)[4][SS], size_t first, int count)
+    {
+        for (int v = 0; v < N; v++)
+        {
+            int mask = candidates<V>(st[0][v]);
+            if (mask == 0)
+                continue;
+            alignas(64) bit32 words[4][V::lanes];
+            for (int r = 0; r < 4; r++)
+            {
+                V::store_words(st[r][v], words[r]);
+            }
+            for (int l = 0; l < V::lanes; l++)
+            {
+                int lane = V::lanes * v + l;
+                if ((mask >> l & 1) && lane < count)
+                {
+                    bit32 state[4] = {words[0][l], words[1][l], words[2][l], words[3][l]};
+                    verify(state, first + lane);
+                }
+            }
+        }
+        for (int v = 0; v < S; v++)
+        {
+            int lane = V::lanes * N + v;
+            if (lane < count && candidates<ScalarOps>(sst[0][v]))
+            {
+                bit32 state[4] = {sst[0][v], sst[1][v], sst[2][v], sst[3][v]};
+                verify(state, first + lane);
+            }
+        }
+    }
+};
+
+/**
+ * MD5CrackBatch: 破解模式的批量接口：计算每条输入的MD5并与目标集合比较，只记录命中的结果
+ * 未命中的消息不写回任何摘要；各线程先把命中记录在自己的数组中，最后合并并按输入下标排序
+ * @param inputs 输入字符串数组，不会被修改
+ * @param count 输入字符串的总数
+ * @param targets 目标集合
+ * @param[out] hits 追加命中的(输入下标, 摘要)
+ * @param ways 交错的向量个数（1/2/3）
+ * @param scalar_lanes 与向量一起交错计算的标量消息数（0/1/2）
+ */
+template <class V>
+void MD5CrackBatch(const string *inputs, size_t count, const MD5TargetSet &targets, vector<MD5Hit> &hits, int ways,
+                   int scalar_lanes = 0)
+{
+    if (targets.digests.empty())
+        return;
+    size_t old_size = hits.size();
+    MD5ForEachChunk(inputs, count, [&](const Byte *const *paddedMessages, const int *n_blocks, size_t n, size_t base) {
+        vector<MD5Hit> local;
+        MD5MatchTargets finish = {&targets, &local};
+        MD5CompressMessages<V>(paddedMessages, n_blocks, n, ways, scalar_lanes, base, finish);
+        if (!local.empty())
+        {
+#pragma omp critical(md5_crack_hits)
+            hits.insert(hits.end(), local.begin(), local.end());
+        }
+    });
+    sort(hits.begin() + old_size, hits.end(), [](const MD5Hit &x, const MD5Hit &y) { return x.index < y.index; });
+}
+
+// ==================== 单目标模式 ====================
+// 只有一个目标且消息只有1块时，摘要减去初始值就是第64步之后的状态。最后几步（第四轮的II步）只用到
+// x[MD5MessageIndex(i)]这几个消息字，它们在短口令中都是常量（通常为0），因此可以从目标状态往回逆推这几步，
+// 每条候选消息只需计算前64-MD5_REVERSE_STEPS步就能与逆推的状态比较，绝大多数通道提前被拒绝。
+
+// 从目标往回逆推的步数：第60~63步，分别使用x[4]、x[11]、x[2]、x[9]，长度小于8字节的口令中它们全为0
+#define MD5_REVERSE_STEPS 4
+
+/**
+ * MD5ReverseState: 由目标摘要和被逆推的几步所用的消息字，求出第64-MD5_REVERSE_STEPS步之后的状态
+ * 第i步只改写一个寄存器：a' = b + rotl(a + f(b,c,d) + x + K, s)，其余三个寄存器不变，所以可以逐步求出a
+ * @param digest 目标摘要（与MD5Hash输出相同的字节序）
+ * @param x 消息字，只使用被逆推的几步对应的下标
+ * @param[out] st 逆推得到的(a, b, c, d)
+ */
+MD5_INLINE void MD5ReverseState(const bit32 *digest, const bit32 *x, bit32 (&st)[4])
+{
+    for (int r = 0; r < 4; r++)
+    {
+        st[r] = __builtin_bswap32(digest[r]) - MD5InitState[r];
+    }
+    for (int i = 63; i >= 64 - MD5_REVERSE_STEPS; i--)
+    {
+        int ta = MD5Target(i), tb = (ta + 1) % 4, tc = (ta + 2) % 4, td = (ta + 3) % 4;
+        bit32 b = st[tb], c = st[tc], d = st[td];
+        bit32 f = i < 16 ? F(b, c, d) : i < 32 ? G(b, c, d) : i < 48 ? H(b, c, d) : I(b, c, d);
+        bit32 t = st[ta] - b;
+        st[ta] = ROTATELEFT(t, 32 - MD5Shift(i)) - f - x[MD5MessageIndex(i)] - MD5K[i];
+    }
+}
+
+// 读取已填充消息的第k个字（小端）
+MD5_INLINE bit32 MD5MessageWord(const Byte *message, int k)
+{
+    const Byte *p = message + 4 * k;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((bit32)p[3] << 24);
+}
+
+/**
+ * MD5ReverseLanes: 单目标模式的快速路径：一批单块消息只计算前64-MD5_REVERSE_STEPS步，与逆推的状态比较
+ * 四个寄存器都相等的通道才是候选，再用MD5Hash完整验证后记录
+ * @param reversed 逆推得到的状态（这一批被逆推的几步所用的消息字必须相同）
+ */
+template <class V, int N>
+void MD5ReverseLanes(const string *inputs, const Byte *const *paddedMessages, int count, size_t first,
+                     const bit32 *reversed, const bit32 *digest, vector<MD5Hit> &hits)
+{
+    typedef typename V::vec vec;
+    alignas(64) static const Byte zero_block[64] = {0};
+    const Byte *blocks[V::lanes * N];
+    for (int i = 0; i < V::lanes * N; i++)
+    {
+        blocks[i] = i < count ? paddedMessages[i] : zero_block;
+    }
+
+    vec x[N][16];
+    vec st[4][N];
+    for (int v = 0; v < N; v++)
+    {
+        V::load_block(blocks + V::lanes * v, x[v]);
+        for (int r = 0; r < 4; r++)
+        {
+            st[r][v] = V::set1(MD5InitState[r]);
+        }
+    }
+
+    MD5Steps<V, N, 0, 64 - MD5_REVERSE_STEPS>(st, x);
+
+    for (int v = 0; v < N; v++)
+    {
+        vec eq = V::cmpeq(st[0][v], V::set1(reversed[0]));
+        for (int r = 1; r < 4; r++)
+        {
+            eq = V::select(V::cmpeq(st[r][v], V::set1(reversed[r])), eq, V::set1(0));
+        }
+        int mask = V::movemask(eq);
+        for (int l = 0; mask != 0 && l < V::lanes; l++)
+        {
+            int lane = V::lanes * v + l;
+            if ((mask >> l & 1) && lane < count)
+            {
+                MD5Hit hit;
+                hit.index = first + lane;
+                MD5Hash(inputs[first + lane], hit.digest);
+                if (memcmp(hit.digest, digest, sizeof(hit.digest)) == 0)
+                {
+                    hits.push_back(hit);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * MD5CrackSingleBatch: 单目标模式的批量接口
+ * 每一批（V::lanes*ways条）如果都是单块消息，且被逆推的几步所用的消息字在各通道中相同，就走逆推的快速路径；
+ * 否则（长口令等）退回普通的破解模式。消息字全为0时使用预先逆推好的状态，其他取值按批现算（只有几步标量运算）
+ * @param target 由md5_prepare_single_target准备好的目标
+ * @param[out] hits 追加命中的(输入下标, 摘要)，按下标排序
+ */
+template <class V>
+void MD5CrackSingleBatch(const string *inputs, size_t count, const MD5SingleTarget &target, vector<MD5Hit> &hits,
+                         int ways)
+{
+    size_t old_size = hits.size();
+    const int groups_max = ways < 1 ? 1 : ways > 3 ? 3 : ways;
+    MD5ForEachChunk(inputs, count, [&](const Byte *const *paddedMessages, const int *n_blocks, size_t n, size_t base) {
+        vector<MD5Hit> local;
+        MD5MatchTargets fallback = {&target.set, &local};
+        size_t done = 0;
+        int groups = groups_max;
+        while (done < n)
+        {
+            while (groups > 1 && n - done < (size_t)(V::lanes * groups))
+            {
+                groups -= 1;
+            }
+            int m = (int)(n - done < (size_t)(V::lanes * groups) ? n - done : V::lanes * groups);
+
+            // 检查这一批能否走快速路径
+            bit32 x[16] = {0};
+            bool uniform = true;
+            for (int i = 0; uniform && i < m; i++)
+            {
+                uniform = n_blocks[done + i] == 1;
+                for (int j = 64 - MD5_REVERSE_STEPS; uniform && j < 64; j++)
+                {
+                    int k = MD5MessageIndex(j);
+                    bit32 w = MD5MessageWord(paddedMessages[done + i], k);
+                    uniform = i == 0 || w == x[k];
+                    x[k] = w;
+                }
+            }
+
+            if (uniform)
+            {
+                bit32 computed[4];
+                const bit32 *reversed = target.reversed_zero;
+                for (int j = 64 - MD5_REVERSE_STEPS; j < 64; j++)
+                {
+                    if (x[MD5MessageIndex(j)] != 0)
+                    {
+                        MD5ReverseState(target.digest, x, computed);
+                        reversed = computed;
+                        break;
+                    }
+                }
+                if (groups == 3)
+                    MD5ReverseLanes<V, 3>(inputs, paddedMessages + done, m, base + done, reversed, target.digest, local);
+                else if (groups == 2)
+                    MD5ReverseLanes<V, 2>(inputs, paddedMessages + done, m, base + done, reversed, target.digest, local);
+                else
+                    MD5ReverseLanes<V, 1>(inputs, paddedMessages + done, m, base + done, reversed, target.digest, local);
+            }
+            else
+            {
+                MD5CompressLanesWays<V, 0>(groups, paddedMessages + done, n_blocks + done, m, base + done, fallback);
+            }
+            done += m;
+        }
+        if (!local.empty())
+        {
+#pragma omp critical(md5_crack_hits)
+            hits.insert(hits.end(), local.begin(), local.end());
+        }
+    });
+    sort(hits.begin() + old_size, hits.end(), [](const MD5Hit &x, const MD5Hit &y) { return x.index < y.index; });
+}
+
+/**
+ * MD5Autotune: 在候选实现中选出当前机器上最快的一个
+ * 混合内核能否获益取决于核心的标量/向量端口数量，无法静态判断，因此用一小批口令实测
+ * @param candidates 当前CPU支持的候选实现
+ * @param n 候选个数
+ * @param run 以指定实现执行一次批量哈希的函数
+ */
+template <class Run>
+MD5Impl MD5Autotune(const MD5Impl *candidates, int n, Run run)
+{
+    const size_t count = 4096;
+    vector<string> inputs(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        inputs[i] = "password" + to_string(i * 2654435761u % 1000000);
+    }
+    vector<bit32> digests(count * 4);
+
+    MD5Impl best = candidates[0];
+    double best_time = 0;
+    for (int c = 0; c < n; c++)
+    {
+        // 先运行一次预热（分配工作区、装入指令缓存），再取3次中的最短时间
+        run(inputs.data(), count, digests.data(), candidates[c]);
+        double elapsed = 0;
+        for (int rep = 0; rep < 3; rep++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            run(inputs.data(), count, digests.data(), candidates[c]);
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            elapsed = rep == 0 || t < elapsed ? t : elapsed;
+        }
+        if (c == 0 || elapsed < best_time)
+        {
+            best = candidates[c];
+            best_time = elapsed;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+#endif // MD5_CORE_H
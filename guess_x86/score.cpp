@@ -0,0 +1,287 @@
+#include "PCFG.h"
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// 口令打分：给定已训练（并已order）的模型，直接计算口令的概率，而无需枚举到这条口令
+// 概率的定义与CalProb一致：PT的概率乘以每个segment取到对应value的概率
+// 切分复用Tokenize，PT和value都通过哈希表查找，因此单条口令的代价与模型大小无关
+
+// 文件打分时每个分块的大小。分块越小负载越均衡，但分块边界需要对齐到换行符
+#define SCORE_CHUNK_BYTES (1 << 20)
+
+bool model::Score(const char *pw, int len, PasswordScore &score) const
+{
+    score = PasswordScore();
+    // 每个线程复用自己的缓冲区，避免逐条口令分配内存
+    thread_local vector<Token> tokens;
+    thread_local string key;
+    Tokenize(pw, len, tokens);
+    key.clear();
+    for (const Token &tok : tokens)
+    {
+        AppendShapeKey(key, tok.type, tok.length);
+    }
+    auto pt = pt_index.find(key);
+    if (pt == pt_index.end())
+    {
+        return false;
+    }
+    score.pt = pt->second;
+    score.preterm_prob = ordered_pts[pt->second].preterm_prob;
+
+    double value_prob = 1;
+    for (const Token &tok : tokens)
+    {
+        // PT存在时它的每个segment也一定存在
+        const SegmentStats *seg = GetSegment(tok.type, tok.length);
+        const int *value = seg->values.find(pw + tok.start, tok.length);
+        if (value == nullptr)
+        {
+            return false;
+        }
+        value_prob *= seg->key_freq(*value) / seg->total_freq;
+    }
+    score.value_prob = value_prob;
+    score.prob = score.preterm_prob * value_prob;
+    return true;
+}
+
+void model::ScoreBatch(const string *pws, size_t count, PasswordScore *scores) const
+{
+#pragma omp parallel for schedule(dynamic, 4096)
+    for (size_t i = 0; i < count; i += 1)
+    {
+        Score(pws[i].data(), pws[i].length(), scores[i]);
+    }
+}
+
+/// @brief 对内存中的文本逐行打分，每行一条口令（忽略行尾的'\r'）
+/// @param data 文本起始地址
+/// @param size 文本字节数
+/// @param scores 输出，scores[i]对应第i行
+static void ScoreText(const model &m, const char *data, size_t size, vector<PasswordScore> &scores)
+{
+    // 把文本切成若干分块，分块起点对齐到行首
+    vector<size_t> bounds;
+    bounds.push_back(0);
+    for (size_t pos = SCORE_CHUNK_BYTES; pos < size; pos += SCORE_CHUNK_BYTES)
+    {
+        if (pos <= bounds.back())
+        {
+            continue;
+        }
+        const char *nl = (const char *)memchr(data + pos, '\n', size - pos);
+        if (nl == nullptr)
+        {
+            break;
+        }
+        bounds.push_back(nl - data + 1);
+    }
+    bounds.push_back(size);
+    int chunks = bounds.size() - 1;
+
+    // 第一遍：数出每个分块的行数，从而确定每个分块结果的写入位置
+    vector<size_t> first_line(chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunks; c += 1)
+    {
+        size_t lines = 0;
+        const char *p = data + bounds[c];
+        const char *end = data + bounds[c + 1];
+        while (p < end)
+        {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            lines += 1;
+            p = nl == nullptr ? end : nl + 1;
+        }
+        first_line[c + 1] = lines;
+    }
+    for (int c = 0; c < chunks; c += 1)
+    {
+        first_line[c + 1] += first_line[c];
+    }
+    scores.assign(first_line[chunks], PasswordScore());
+
+    // 第二遍：各分块独立打分
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunks; c += 1)
+    {
+        size_t line = first_line[c];
+        const char *p = data + bounds[c];
+        const char *end = data + bounds[c + 1];
+        while (p < end)
+        {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            const char *line_end = nl == nullptr ? end : nl;
+            int len = line_end - p;
+            if (len > 0 && p[len - 1] == '\r')
+            {
+                len -= 1;
+            }
+            m.Score(p, len, scores[line]);
+            line += 1;
+            p = line_end + 1;
+        }
+    }
+}
+
+bool model::ScoreFile(const string &path, vector<PasswordScore> &scores) const
+{
+    scores.clear();
+#ifdef _WIN32
+    // Windows下没有mmap，整体读入内存
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    ScoreText(*this, text.data(), text.size(), scores);
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return true;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    ScoreText(*this, (const char *)data, size, scores);
+    munmap(data, size);
+    return true;
+#endif
+}
+
+// 抽样时每个分块的样本数。每个分块使用由seed和分块号决定的独立随机数序列，因此结果与线程数无关
+#define ESTIMATE_CHUNK 65536
+
+void GuessNumberEstimator::build(const model &m, size_t sample_count, unsigned long long seed)
+{
+    // 抽样表：PT按preterm_prob的累计分布抽取，segment的value按频数的累计分布抽取
+    // 抽样只关心频数，不关心名次，因此value按values中的映射值（见SegmentStats::key_freq）排列即可，无需排好序
+    vector<double> pt_cdf(m.ordered_pts.size());
+    double pt_total = 0;
+    for (int i = 0; i < m.ordered_pts.size(); i += 1)
+    {
+        pt_total += m.ordered_pts[i].preterm_prob;
+        pt_cdf[i] = pt_total;
+    }
+    vector<vector<double>> letters_cdf(m.letters.size()), digits_cdf(m.digits.size()), symbols_cdf(m.symbols.size());
+    auto build_cdf = [](const vector<SegmentStats> &segs, vector<vector<double>> &cdfs)
+    {
+        for (int i = 0; i < segs.size(); i += 1)
+        {
+            double sum = 0;
+            for (int key = 0; key < segs[i].value_count(); key += 1)
+            {
+                sum += segs[i].key_freq(key);
+                cdfs[i].push_back(sum);
+            }
+        }
+    };
+    build_cdf(m.letters, letters_cdf);
+    build_cdf(m.digits, digits_cdf);
+    build_cdf(m.symbols, symbols_cdf);
+
+    probs.assign(sample_count, 0);
+    size_t chunks = (sample_count + ESTIMATE_CHUNK - 1) / ESTIMATE_CHUNK;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < chunks; c += 1)
+    {
+        mt19937_64 rng(seed * 0x9e3779b97f4a7c15ULL + c);
+        uniform_real_distribution<double> uniform(0, 1);
+        size_t end = min(sample_count, (c + 1) * ESTIMATE_CHUNK);
+        for (size_t i = c * ESTIMATE_CHUNK; i < end; i += 1)
+        {
+            int pt_id = upper_bound(pt_cdf.begin(), pt_cdf.end(), uniform(rng) * pt_total) - pt_cdf.begin();
+            pt_id = min<int>(pt_id, pt_cdf.size() - 1);
+            const PT &pt = m.ordered_pts[pt_id];
+            double prob = pt.preterm_prob;
+            for (const SegmentShape &shape : pt.content)
+            {
+                int id = shape.type == 1 ? m.letters_index[shape.length] : (shape.type == 2 ? m.digits_index[shape.length] : m.symbols_index[shape.length]);
+                const SegmentStats &seg = shape.type == 1 ? m.letters[id] : (shape.type == 2 ? m.digits[id] : m.symbols[id]);
+                const vector<double> &cdf = shape.type == 1 ? letters_cdf[id] : (shape.type == 2 ? digits_cdf[id] : symbols_cdf[id]);
+                int key = upper_bound(cdf.begin(), cdf.end(), uniform(rng) * cdf.back()) - cdf.begin();
+                key = min<int>(key, cdf.size() - 1);
+                prob *= seg.key_freq(key) / seg.total_freq;
+            }
+            probs[i] = prob;
+        }
+    }
+
+    sort(probs.begin(), probs.end(), greater<double>());
+    ranks.assign(sample_count + 1, 0);
+    ranks_sq.assign(sample_count + 1, 0);
+    for (size_t i = 0; i < sample_count; i += 1)
+    {
+        ranks[i + 1] = ranks[i] + 1 / (sample_count * probs[i]);
+        ranks_sq[i + 1] = ranks_sq[i] + 1 / (sample_count * probs[i] * probs[i]);
+    }
+}
+
+double GuessNumberEstimator::estimate(double prob, double *low, double *high) const
+{
+    if (prob <= 0)
+    {
+        if (low != nullptr)
+        {
+            *low = INFINITY;
+        }
+        if (high != nullptr)
+        {
+            *high = INFINITY;
+        }
+        return INFINITY;
+    }
+    // 第一个不大于prob的样本之前的样本都对估计有贡献
+    size_t pos = lower_bound(probs.begin(), probs.end(), prob, greater<double>()) - probs.begin();
+    double rank = ranks[pos];
+    // 估计量是n个独立同分布变量 1{p_i>p}/p_i 的均值，其标准误为 sqrt((E[X^2]-E[X]^2)/n)
+    size_t n = probs.size();
+    double variance = n > 0 ? max(0.0, ranks_sq[pos] - rank * rank) / n : 0;
+    double margin = 1.96 * sqrt(variance);
+    if (low != nullptr)
+    {
+        *low = max(0.0, rank - margin);
+    }
+    if (high != nullptr)
+    {
+        *high = rank + margin;
+    }
+    return rank;
+}
+
+double GuessNumberEstimator::estimate(const model &m, const string &pw, double *low, double *high) const
+{
+    PasswordScore score;
+    m.Score(pw.data(), pw.length(), score);
+    return estimate(score.prob, low, high);
+}
@@ -0,0 +1,226 @@
+#include "PCFG.h"
+#include <fstream>
+#include <algorithm>
+#include <climits>
+#include <sstream>
+using namespace std;
+
+// 近似训练（heavy hitter）
+// 猜测生成主要依赖各segment中的高频value，而训练集中大量只出现一次的value要到极靠后的位置才会被用到。
+// 这里用Space-Saving算法（Metwally et al., 2005）为每个segment和PT只保留固定数目的计数器：
+// - 已保留的key出现时，计数加1
+// - 未保留的key出现且计数器已满时，替换计数最小的key，新计数为最小计数加1，并把原最小计数记为误差
+// 所有计数之和恰好等于流的长度N，每个保留的计数c满足 c-error <= 真实频数 <= c，且 error <= N/capacity。
+// 真实频数大于N/capacity的key一定会被保留
+
+// Space-Saving计数器。用按计数排序的小根堆找最小计数，计数加1时只需向下调整
+class SpaceSaving
+{
+public:
+    explicit SpaceSaving(int capacity) : capacity(capacity) {}
+
+    void add(const string &key)
+    {
+        stream += 1;
+        auto it = slot.find(key);
+        if (it != slot.end())
+        {
+            counts[it->second] += 1;
+            sift_down(pos[it->second]);
+            return;
+        }
+        if (keys.size() < capacity)
+        {
+            int s = keys.size();
+            slot.emplace(key, s);
+            keys.push_back(key);
+            counts.push_back(1);
+            errors.push_back(0);
+            pos.push_back(heap.size());
+            heap.push_back(s);
+            sift_up(heap.size() - 1);
+            return;
+        }
+        // 替换计数最小的key
+        int s = heap[0];
+        slot.erase(keys[s]);
+        keys[s] = key;
+        slot.emplace(key, s);
+        errors[s] = counts[s];
+        counts[s] += 1;
+        sift_down(0);
+    }
+
+    int capacity;
+    long long stream = 0;       // 流的长度N，也等于所有计数之和
+    vector<string> keys;        // 每个计数器当前对应的key
+    vector<long long> counts;   // 计数（真实频数的上界）
+    vector<long long> errors;   // 计数的最大高估量
+
+private:
+    unordered_map<string, int> slot; // key到计数器的映射
+    vector<int> heap;                // 按计数排序的小根堆，元素为计数器下标
+    vector<int> pos;                 // 计数器在堆中的位置
+
+    void swap_nodes(int a, int b)
+    {
+        swap(heap[a], heap[b]);
+        pos[heap[a]] = a;
+        pos[heap[b]] = b;
+    }
+
+    void sift_up(int i)
+    {
+        while (i > 0 && counts[heap[(i - 1) / 2]] > counts[heap[i]])
+        {
+            swap_nodes(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void sift_down(int i)
+    {
+        while (true)
+        {
+            int smallest = i;
+            int l = 2 * i + 1, r = 2 * i + 2;
+            if (l < heap.size() && counts[heap[l]] < counts[heap[smallest]])
+            {
+                smallest = l;
+            }
+            if (r < heap.size() && counts[heap[r]] < counts[heap[smallest]])
+            {
+                smallest = r;
+            }
+            if (smallest == i)
+            {
+                return;
+            }
+            swap_nodes(i, smallest);
+            i = smallest;
+        }
+    }
+};
+
+/// @brief 打印一个Space-Saving结构的误差界
+/// @param name 名字，例如L6
+static void ReportErrors(const string &name, const SpaceSaving &ss)
+{
+    long long max_error = 0;
+    long long min_count = LLONG_MAX;
+    int exact = 0;
+    for (int i = 0; i < ss.keys.size(); i += 1)
+    {
+        max_error = max(max_error, ss.errors[i]);
+        min_count = min(min_count, ss.counts[i]);
+        exact += ss.errors[i] == 0;
+    }
+    // 计数下界超过最小计数的key，一定属于真实的前capacity名
+    int guaranteed = 0;
+    for (int i = 0; i < ss.keys.size(); i += 1)
+    {
+        guaranteed += ss.counts[i] - ss.errors[i] > min_count || ss.keys.size() < ss.capacity;
+    }
+    cout << name << ": N=" << ss.stream << " kept=" << ss.keys.size() << " max_error=" << max_error
+         << " (bound " << ss.stream / ss.capacity << ") exact=" << exact << " guaranteed_top=" << guaranteed << endl;
+}
+
+void model::train_heavy_hitters(string path, int value_capacity, int pt_capacity)
+{
+    // segment的种类（类型和长度）很少，精确统计；每个segment的value以及PT用Space-Saving统计
+    vector<int> segment_ids[4];
+    vector<SpaceSaving> value_counters[4];
+    // PT以结构键（见AppendShapeKey）计数，训练结束后由键还原PT
+    SpaceSaving pt_counter(pt_capacity);
+
+    vector<Token> tokens;
+    string key;
+    string pw;
+    ifstream train_set(path);
+    long long lines = 0;
+    cout << "Training (heavy hitters)..." << endl;
+    cout << "Training phase 1: reading and counting passwords..." << endl;
+    while (train_set >> pw)
+    {
+        lines += 1;
+        if (lines % 1000000 == 0)
+        {
+            cout << "Lines processed: " << lines << endl;
+        }
+        Tokenize(pw.data(), pw.length(), tokens);
+        if (!ShapesFit(tokens))
+        {
+            continue;
+        }
+        key.clear();
+        for (const Token &tok : tokens)
+        {
+            AppendShapeKey(key, tok.type, tok.length);
+            vector<int> &ids = segment_ids[tok.type];
+            if (tok.length >= ids.size())
+            {
+                ids.resize(tok.length + 1, -1);
+            }
+            if (ids[tok.length] == -1)
+            {
+                vector<SegmentStats> &segs = tok.type == 1 ? letters : (tok.type == 2 ? digits : symbols);
+                vector<long long> &segs_freq = tok.type == 1 ? letters_freq : (tok.type == 2 ? digits_freq : symbols_freq);
+                ids[tok.length] = tok.type == 1 ? GetNextLettersID() : (tok.type == 2 ? GetNextDigitsID() : GetNextSymbolsID());
+                segs.emplace_back(tok.type, tok.length);
+                segs_freq.emplace_back(0);
+                value_counters[tok.type].emplace_back(value_capacity);
+            }
+            int id = ids[tok.length];
+            (tok.type == 1 ? letters_freq : (tok.type == 2 ? digits_freq : symbols_freq))[id] += 1;
+            value_counters[tok.type][id].add(pw.substr(tok.start, tok.length));
+        }
+        pt_counter.add(key);
+    }
+
+    // 由保留的计数建立模型：所有计数之和等于N，因此概率仍然归一
+    cout << "Training phase 2: building model from retained counts..." << endl;
+    for (int i = 0; i < pt_counter.keys.size(); i += 1)
+    {
+        // 结构键中每个segment占3个字节：类型、长度的低8位、长度的高8位
+        PT pt;
+        const string &k = pt_counter.keys[i];
+        for (int j = 0; j + 2 < k.size(); j += 3)
+        {
+            pt.insert(SegmentShape(k[j], (unsigned char)k[j + 1] | ((unsigned char)k[j + 2] << 8)));
+        }
+        pt.curr_indices.assign(pt.content.size(), 0);
+        GetNextPretermID();
+        preterminals.emplace_back(pt);
+        preterm_freq.emplace_back(pt_counter.counts[i]);
+    }
+    total_preterm = pt_counter.stream;
+    ReportErrors("PT", pt_counter);
+
+    for (int type = 1; type <= 3; type += 1)
+    {
+        vector<SegmentStats> &segs = type == 1 ? letters : (type == 2 ? digits : symbols);
+        for (int id = 0; id < segs.size(); id += 1)
+        {
+            SpaceSaving &ss = value_counters[type][id];
+            vector<int> order(ss.keys.size());
+            for (int i = 0; i < order.size(); i += 1)
+            {
+                order[i] = i;
+            }
+            // 计数降序，计数相同时按value升序
+            sort(order.begin(), order.end(), [&](int a, int b)
+                 { return ss.counts[a] != ss.counts[b] ? ss.counts[a] > ss.counts[b] : ss.keys[a] < ss.keys[b]; });
+            vector<string> ordered_values;
+            vector<long long> counts;
+            for (int i : order)
+            {
+                ordered_values.emplace_back(ss.keys[i]);
+                counts.emplace_back(ss.counts[i]);
+            }
+            segs[id].fill_ordered(ordered_values, counts);
+            ostringstream name;
+            name << "LDS"[type - 1] << segs[id].length;
+            ReportErrors(name.str(), ss);
+        }
+    }
+}
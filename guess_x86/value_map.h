@@ -0,0 +1,247 @@
+#ifndef VALUE_MAP_H
+#define VALUE_MAP_H
+
+// 训练时统计segment value和口令用的开放寻址哈希表（Swiss table的思路）
+// unordered_map<string, int>每个条目是一个单独分配的节点，每次查找都要追指针，并且对短字符串使用通用的std::hash。
+// 这里的表只用于以短字节串为键、以int为值的场合：
+// 1. 键依次追加在一块连续的内存里，条目按插入顺序编号，编号就是键在这块内存中的序号
+// 2. 槽位只存条目编号，另有一个字节的控制字节数组：空槽为0x80，已占用的槽存放哈希值的低7位
+// 3. 槽位按16个一组，一次用SSE2/NEON比较一组的16个控制字节，只有控制字节相同的槽才需要比较键
+// 不支持删除（训练时只插入和修改计数），因此也没有墓碑
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// 每组的槽位数，与一个SIMD寄存器的字节数相同
+#define VALUE_MAP_GROUP 16
+// 空槽的控制字节。已占用的槽存放哈希值的低7位，最高位为0
+#define VALUE_MAP_EMPTY 0x80
+
+/// @brief 短字节串的哈希：每次读入8个字节，乘法和移位混合，最后再做一次完整的雪崩
+inline unsigned long long HashBytes(const char *p, int len)
+{
+    unsigned long long h = 0x9e3779b97f4a7c15ULL ^ (unsigned long long)len;
+    while (len >= 8)
+    {
+        unsigned long long w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 31;
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0)
+    {
+        unsigned long long w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 31;
+    }
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 29;
+    return h;
+}
+
+/// @brief 在一组16个控制字节中查找等于tag的字节
+/// @return 位掩码，每个槽对应VALUE_MAP_MASK_BITS位，只有每段的最高位可能为1
+#if defined(__ARM_NEON)
+#define VALUE_MAP_MASK_BITS 4
+inline unsigned long long MatchGroup(const unsigned char *ctrl, unsigned char tag)
+{
+    // NEON没有movemask：比较结果每个字节为0x00或0xff，右移4位并收窄后每个字节变成4位
+    uint8x16_t eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(tag));
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ULL;
+}
+#elif defined(__SSE2__)
+#define VALUE_MAP_MASK_BITS 1
+inline unsigned long long MatchGroup(const unsigned char *ctrl, unsigned char tag)
+{
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)ctrl), _mm_set1_epi8(char(tag)));
+    return unsigned(_mm_movemask_epi8(eq));
+}
+#else
+#define VALUE_MAP_MASK_BITS 1
+inline unsigned long long MatchGroup(const unsigned char *ctrl, unsigned char tag)
+{
+    unsigned long long mask = 0;
+    for (int i = 0; i < VALUE_MAP_GROUP; i += 1)
+    {
+        if (ctrl[i] == tag)
+        {
+            mask |= 1ULL << i;
+        }
+    }
+    return mask;
+}
+#endif
+
+class ValueMap
+{
+public:
+    ValueMap()
+    {
+        offsets.push_back(0);
+    }
+
+    // 条目数
+    int size() const
+    {
+        return vals.size();
+    }
+
+    // 第i个插入的条目的键、键长和值
+    const char *key(int i) const
+    {
+        return keys.data() + offsets[i];
+    }
+    int key_length(int i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+    int &value(int i)
+    {
+        return vals[i];
+    }
+    int value(int i) const
+    {
+        return vals[i];
+    }
+
+    // 查找键，找不到时返回nullptr
+    const int *find(const char *k, int len) const
+    {
+        if (vals.empty())
+        {
+            return nullptr;
+        }
+        unsigned long long h = HashBytes(k, len);
+        int slot = probe(k, len, h);
+        return ctrl[slot] != VALUE_MAP_EMPTY ? &vals[slots[slot]] : nullptr;
+    }
+
+    // 一次查找完成"查找或插入"：键不存在时以value插入，inserted置为true。返回条目值的引用
+    int &find_or_insert(const char *k, int len, int value, bool &inserted)
+    {
+        if ((vals.size() + 1) * 8 > ctrl.size() * 7)
+        {
+            rehash(max<size_t>(ctrl.size() * 2, VALUE_MAP_GROUP));
+        }
+        unsigned long long h = HashBytes(k, len);
+        int slot = probe(k, len, h);
+        inserted = ctrl[slot] == VALUE_MAP_EMPTY;
+        if (inserted)
+        {
+            ctrl[slot] = h & 0x7f;
+            slots[slot] = vals.size();
+            keys.insert(keys.end(), k, k + len);
+            offsets.push_back(keys.size());
+            vals.push_back(value);
+        }
+        return vals[slots[slot]];
+    }
+
+    // 预留n个条目的空间，避免插入过程中多次rehash
+    void reserve(size_t n)
+    {
+        size_t capacity = VALUE_MAP_GROUP;
+        while (n * 8 > capacity * 7)
+        {
+            capacity *= 2;
+        }
+        if (capacity > ctrl.size())
+        {
+            rehash(capacity);
+        }
+        vals.reserve(n);
+        offsets.reserve(n + 1);
+    }
+
+    void clear()
+    {
+        ValueMap().swap(*this);
+    }
+
+    void swap(ValueMap &other)
+    {
+        ctrl.swap(other.ctrl);
+        slots.swap(other.slots);
+        keys.swap(other.keys);
+        offsets.swap(other.offsets);
+        vals.swap(other.vals);
+    }
+
+private:
+    vector<unsigned char> ctrl; // 控制字节，大小为槽数（2的幂，至少一组）
+    vector<int> slots;          // 每个已占用的槽对应的条目编号
+    vector<char> keys;          // 所有键按插入顺序连续存放
+    vector<unsigned> offsets;   // 第i个键位于keys[offsets[i], offsets[i+1])
+    vector<int> vals;           // 第i个条目的值
+
+    /// @brief 按组探测：返回键所在的槽，键不存在时返回应当插入的空槽
+    /// 第一个空槽之后不可能再有这个键（没有删除），组之间按三角数步长跳跃，可以遍历所有的组
+    int probe(const char *k, int len, unsigned long long h) const
+    {
+        unsigned char tag = h & 0x7f;
+        size_t group_mask = ctrl.size() / VALUE_MAP_GROUP - 1;
+        size_t group = (h >> 7) & group_mask;
+        for (size_t step = 1;; step += 1)
+        {
+            const unsigned char *g = ctrl.data() + group * VALUE_MAP_GROUP;
+            unsigned long long match = MatchGroup(g, tag);
+            while (match != 0)
+            {
+                int i = __builtin_ctzll(match) / VALUE_MAP_MASK_BITS;
+                match &= match - 1;
+                int entry = slots[group * VALUE_MAP_GROUP + i];
+                if (key_length(entry) == len && memcmp(key(entry), k, len) == 0)
+                {
+                    return group * VALUE_MAP_GROUP + i;
+                }
+            }
+            unsigned long long empty = MatchGroup(g, VALUE_MAP_EMPTY);
+            if (empty != 0)
+            {
+                return group * VALUE_MAP_GROUP + __builtin_ctzll(empty) / VALUE_MAP_MASK_BITS;
+            }
+            group = (group + step) & group_mask;
+        }
+    }
+
+    // 扩容到capacity个槽，按插入顺序把所有条目重新放入
+    void rehash(size_t capacity)
+    {
+        ctrl.assign(capacity, VALUE_MAP_EMPTY);
+        slots.assign(capacity, 0);
+        size_t group_mask = capacity / VALUE_MAP_GROUP - 1;
+        for (int entry = 0; entry < size(); entry += 1)
+        {
+            unsigned long long h = HashBytes(key(entry), key_length(entry));
+            size_t group = (h >> 7) & group_mask;
+            for (size_t step = 1;; step += 1)
+            {
+                unsigned long long empty = MatchGroup(ctrl.data() + group * VALUE_MAP_GROUP, VALUE_MAP_EMPTY);
+                if (empty != 0)
+                {
+                    size_t slot = group * VALUE_MAP_GROUP + __builtin_ctzll(empty) / VALUE_MAP_MASK_BITS;
+                    ctrl[slot] = h & 0x7f;
+                    slots[slot] = entry;
+                    break;
+                }
+                group = (group + step) & group_mask;
+            }
+        }
+    }
+};
+
+#endif